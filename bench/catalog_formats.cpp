@@ -0,0 +1,140 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <benchmark/benchmark.h>
+#include <boost/format.hpp>
+
+#include "catalog.hpp"
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+
+constexpr std::size_t ROWS = 100000;
+
+
+std::string tycho2_row(std::mt19937& rng) {
+    std::uniform_real_distribution<double> ra(0, 360), de(-90, 90), mag(6, 13), pm(-50, 50);
+    const auto a = ra(rng);
+    const auto d = de(rng);
+    return (
+        boost::format(
+            "0001 00008 1| |%1$12.8f|%2$12.8f|%3$7.1f|%4$7.1f|  5|  5| 1.0| 1.0|1990.50|1990.50| 5|1.0|1.0|1.0|1.0"
+            "|%5$6.3f|0.100|%6$6.3f|0.100|999| |         |%1$12.8f|%2$12.8f|1.70|1.70|  5.0|  5.0| | 0.0"
+        ) % a % d % pm(rng) % pm(rng) % mag(rng) % mag(rng)
+    ).str();
+}
+
+
+std::string tycho2_suppl_row(std::mt19937& rng) {
+    std::uniform_real_distribution<double> ra(0, 360), de(-90, 90), mag(0, 8), pm(-50, 50);
+    return (
+        boost::format("0001 00008 2|H|%1$12.8f|%2$12.8f|%3$7.1f|%4$7.1f|  1.0|  1.0|  1.0|  1.0|V|      |     |%5$6.3f|0.010|999| |    12   ")
+        % ra(rng) % de(rng) % pm(rng) % pm(rng) % mag(rng)
+    ).str();
+}
+
+
+std::string hipparcos_row(std::mt19937& rng) {
+    std::uniform_real_distribution<double> ra(0, 360), de(-90, 90), mag(-1, 12), pm(-50, 50);
+    auto row = (
+        boost::format("H|%1$6d| |00 00 00.22|+01 05 20.4|%2$5.2f| |H|%3$12.8f|%4$+12.8f| |%5$7.2f|%6$8.2f|%7$8.2f")
+        % 12345 % mag(rng) % ra(rng) % de(rng) % 3.54 % pm(rng) % pm(rng)
+    ).str();
+    // hip_main.dat has 78 fields; the rest are not read
+    for (int i = 14; i < 78; i++)
+        row += "|     ";
+    return row;
+}
+
+
+std::string gaia_row(std::mt19937& rng) {
+    std::uniform_real_distribution<double> ra(0, 360), de(-90, 90), mag(3, 21), color(-0.5, 4), pm(-50, 50);
+    return (
+        boost::format("4295806720,%1$.12f,%2$.12f,%3$.6f,%4$.6f,%5$.6f,%6$.6f")
+        % ra(rng) % de(rng) % pm(rng) % pm(rng) % mag(rng) % color(rng)
+    ).str();
+}
+
+
+std::string csv_row(std::mt19937& rng) {
+    std::uniform_real_distribution<double> ra(0, 360), de(-90, 90), mag(-1, 15);
+    return (boost::format("%1$.8f,%2$.8f,%3$.3f") % ra(rng) % de(rng) % mag(rng)).str();
+}
+
+
+/**
+ * \brief   Writes a synthetic catalog of the given format to a temporary file.
+ */
+class SyntheticCatalog {
+    public:
+        SyntheticCatalog(
+                    const std::string& format_name,
+                    const std::string& header,
+                    std::string (*row)(std::mt19937&)
+        ):
+                path((fs::temp_directory_path() / ("starfinder_bench_" + format_name + ".dat")).string()),
+                bytes(0)
+        {
+            std::mt19937 rng(42);
+            std::ofstream file(path);
+            if (!header.empty())
+                file << header << '\n';
+            for (std::size_t i = 0; i < ROWS; i++)
+                file << row(rng) << '\n';
+            bytes = file.tellp();
+        }
+
+        ~SyntheticCatalog() {
+            std::remove(path.c_str());
+        }
+
+        const std::string path;
+        std::size_t bytes;
+};
+
+
+/**
+ * \brief   Streams a catalog through the shared reader and parser, as read_stars() does.
+ */
+void BM_ReadCatalog(
+        benchmark::State& state,
+        const std::string& format_name,
+        const std::string& header,
+        std::string (*row)(std::mt19937&)
+) {
+    const SyntheticCatalog catalog(format_name, header, row);
+    const auto& format = catalog_format(format_name);
+
+    for (auto _ : state) {
+        CatalogReader reader(catalog.path, format);
+        ParseArena arena;
+        Record record(&arena);
+        std::size_t stars = 0;
+        while (reader.next(record)) {
+            try {
+                const auto star = parse_star_record(record, reader.format());
+                benchmark::DoNotOptimize(star.mag);
+                stars++;
+            }
+            catch (const std::runtime_error&) {}
+        }
+        benchmark::DoNotOptimize(stars);
+    }
+
+    state.SetItemsProcessed(state.iterations() * ROWS);
+    state.SetBytesProcessed(state.iterations() * catalog.bytes);
+}
+
+}
+
+
+BENCHMARK_CAPTURE(BM_ReadCatalog, tycho2, "tycho2", "", tycho2_row)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ReadCatalog, tycho2_suppl, "tycho2-suppl", "", tycho2_suppl_row)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ReadCatalog, hipparcos, "hipparcos", "", hipparcos_row)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ReadCatalog, gaia, "gaia", "source_id,ra,dec,pmra,pmdec,phot_g_mean_mag,bp_rp", gaia_row)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_ReadCatalog, csv, "csv", "ra,dec,mag", csv_row)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <benchmark/benchmark.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "async_reader.hpp"
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+
+/// Size of the file read; override with STARFINDER_BENCH_COLD_MIB
+constexpr std::size_t DEFAULT_MIB = 256;
+
+constexpr char ROW[] =
+    "0001 00008 1| |  2.31750494|  2.23184345|  -16.3|   -9.0| 68| 73| 1.7| 1.8|1958.89|1951.94| 4|1.0|1.0|0.9|1.0"
+    "|12.146|0.158|12.146|0.223|999| |         |  2.31754222|  2.23186444|1.67|1.54| 88.0|100.8| |-0.2\n";
+
+
+/**
+ * \brief   Tycho-2 sized file of repeated rows in the temporary directory.
+ */
+class LargeCatalog {
+    public:
+        LargeCatalog():
+                path((fs::temp_directory_path() / "starfinder_bench_cold.dat").string()),
+                bytes(0)
+        {
+            const char* mib = std::getenv("STARFINDER_BENCH_COLD_MIB");
+            const std::size_t target = (mib != nullptr ? std::strtoull(mib, nullptr, 10) : DEFAULT_MIB) << 20;
+
+            std::string block;
+            for (int i = 0; i < 4096; i++)
+                block += ROW;
+            std::ofstream file(path, std::ios::binary);
+            for (; bytes < target; bytes += block.size())
+                file.write(block.data(), block.size());
+        }
+
+        ~LargeCatalog() {
+            std::remove(path.c_str());
+        }
+
+        const std::string path;
+        std::size_t bytes;
+};
+
+
+const LargeCatalog& large_catalog() {
+    static const LargeCatalog catalog;
+    return catalog;
+}
+
+
+/**
+ * \brief   Evicts the file from the page cache.
+ *
+ * Dropping all caches needs root; otherwise only this file's clean pages are
+ * dropped, which is enough for a cold read of it.
+ *
+ * \return  true if the global drop succeeded
+ */
+bool drop_caches(const std::string& path) {
+    ::sync();
+    bool dropped_all = false;
+    if (std::FILE* drop = std::fopen("/proc/sys/vm/drop_caches", "w")) {
+        dropped_all = std::fputs("1\n", drop) >= 0;
+        dropped_all = (std::fclose(drop) == 0) && dropped_all;
+    }
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+    return dropped_all;
+}
+
+
+/**
+ * \brief   Line-by-line std::ifstream read, as read_stars() does.
+ */
+void BM_ColdReadIfstream(benchmark::State& state) {
+    const auto& catalog = large_catalog();
+    bool dropped_all = false;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        dropped_all = drop_caches(catalog.path);
+        state.ResumeTiming();
+
+        std::ifstream file(catalog.path);
+        std::string line;
+        std::size_t rows = 0;
+        while (std::getline(file, line))
+            rows++;
+        benchmark::DoNotOptimize(rows);
+    }
+
+    state.counters["dropped_all_caches"] = dropped_all;
+    state.SetBytesProcessed(state.iterations() * catalog.bytes);
+}
+
+
+void BM_ColdReadBlocks(
+        benchmark::State& state,
+        const ReadBackend backend
+) {
+    const auto& catalog = large_catalog();
+    AsyncReadOptions options;
+    options.backend = backend;
+    options.depth = state.range(0);
+    bool dropped_all = false;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        dropped_all = drop_caches(catalog.path);
+        state.ResumeTiming();
+
+        std::size_t rows = 0;
+        try {
+            read_file_blocks(
+                catalog.path,
+                0,
+                options,
+                [&rows] (const char* data, const std::size_t size) {
+                    rows += std::count(data, data + size, '\n');
+                }
+            );
+        }
+        catch (const std::runtime_error& e) {
+            state.SkipWithError(e.what());
+            break;
+        }
+        benchmark::DoNotOptimize(rows);
+    }
+
+    state.counters["dropped_all_caches"] = dropped_all;
+    state.SetBytesProcessed(state.iterations() * catalog.bytes);
+}
+
+}
+
+
+BENCHMARK(BM_ColdReadIfstream)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ColdReadBlocks, io_uring, ReadBackend::io_uring)->Arg(1)->Arg(8)->Arg(32)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK_CAPTURE(BM_ColdReadBlocks, pread, ReadBackend::pread)->Arg(1)->Arg(8)->Arg(32)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,62 @@
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "image_output.hpp"
+#include "sky_stars.hpp"
+#include "star_render.hpp"
+
+
+namespace {
+
+/**
+ * \brief   A 8192×4096 map of a million stars, mostly black like the real ones.
+ */
+const cv::Mat& star_map() {
+    static const cv::Mat img = [] {
+        const auto stars = sky_stars(1000000);
+        cv::Mat img;
+        render_stars(stars, StarOrder::catalog, 8192, 4096, 0, 360, -90, 90, std::nullopt, CV_8U, img);
+        return img;
+    }();
+    return img;
+}
+
+
+/**
+ * \brief   encode_image() of the star map.
+ *
+ * \param   state   range(0) ImageFormat, range(1) PNG level, range(2) threads
+ */
+void BM_EncodeImage(benchmark::State& state) {
+    const auto& img = star_map();
+    ImageOptions options;
+    options.format = static_cast<ImageFormat>(state.range(0));
+    options.png_level = state.range(1);
+    options.threads = state.range(2);
+    state.SetLabel(image_format_name(options.format));
+
+    std::size_t size = 0;
+    for (auto _ : state) {
+        const auto encoded = encode_image(img, "", options);
+        size = encoded.size();
+        benchmark::DoNotOptimize(encoded.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * img.total());
+    state.counters["ratio"] = static_cast<double>(size) / img.total();
+}
+
+}
+
+
+BENCHMARK(BM_EncodeImage)
+    ->ArgNames({"format", "level", "threads"})
+    ->Args({static_cast<int>(ImageFormat::png), 1, 1})
+    ->Args({static_cast<int>(ImageFormat::png), 1, 4})
+    ->Args({static_cast<int>(ImageFormat::png), 6, 1})
+    ->Args({static_cast<int>(ImageFormat::png), 6, 4})
+    ->Args({static_cast<int>(ImageFormat::qoi), 0, 1})
+    ->Args({static_cast<int>(ImageFormat::pgm), 0, 1})
+    ->Args({static_cast<int>(ImageFormat::tiff), 0, 1})
+    ->Args({static_cast<int>(ImageFormat::fits), 0, 1})
+    ->Unit(benchmark::kMillisecond);
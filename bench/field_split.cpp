@@ -0,0 +1,195 @@
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "catalog.hpp"
+
+
+namespace {
+
+/// About one parser chunk of Tycho-2 rows
+constexpr std::size_t ROWS = 20000;
+
+constexpr char ROW[] =
+    "0001 00008 1| |  2.31750494|  2.23184345|  -16.3|   -9.0| 68| 73| 1.7| 1.8|1958.89|1951.94| 4|1.0|1.0|0.9|1.0"
+    "|12.146|0.158|12.146|0.223|999| |         |  2.31754222|  2.23186444|1.67|1.54| 88.0|100.8| |-0.2\n";
+
+
+const std::string& chunk_text() {
+    static const std::string text = [] {
+        std::string rows;
+        for (std::size_t i = 0; i < ROWS; i++)
+            rows += ROW;
+        return rows;
+    }();
+    return text;
+}
+
+
+/**
+ * \brief   Calls consume with every line of the text, found with memchr().
+ */
+template<typename Consume>
+void for_each_line(
+        const std::string& text,
+        Consume&& consume
+) {
+    const char* begin = text.data();
+    const char* const end = begin + text.size();
+    while (begin < end) {
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        if (!newline)
+            newline = end;
+        consume(std::string_view(begin, newline - begin));
+        begin = newline + 1;
+    }
+}
+
+
+/**
+ * \brief   The splitter this replaced: one find() per field, each field copied into a reused string.
+ */
+void split_copying(
+        const std::string_view line,
+        const char delimiter,
+        std::pmr::vector<std::pmr::string>& fields
+) {
+    std::size_t count = 0;
+    for (std::size_t begin = 0; ; ) {
+        const auto end = std::min(line.find(delimiter, begin), line.size());
+        const auto field = line.substr(begin, end - begin);
+        if (count < fields.size())
+            fields[count].assign(field.data(), field.size());
+        else
+            fields.emplace_back(field.data(), field.size());
+        count++;
+        if (end == line.size())
+            break;
+        begin = end + 1;
+    }
+    fields.erase(fields.begin() + count, fields.end());
+}
+
+
+void BM_SplitCopying(benchmark::State& state) {
+    const auto& text = chunk_text();
+    std::pmr::monotonic_buffer_resource arena;
+    std::pmr::vector<std::pmr::string> fields(&arena);
+
+    for (auto _ : state)
+        for_each_line(
+            text,
+            [&fields] (const std::string_view line) {
+                split_copying(line, '|', fields);
+                benchmark::DoNotOptimize(fields.data());
+            }
+        );
+
+    state.SetBytesProcessed(state.iterations() * text.size());
+    state.SetItemsProcessed(state.iterations() * ROWS);
+}
+
+
+/**
+ * \brief   Line by line, as CatalogReader splits the rows it reads.
+ */
+void BM_SplitIndexedLines(benchmark::State& state) {
+    const auto& text = chunk_text();
+    ParseArena arena;
+    Record record(&arena);
+
+    for (auto _ : state)
+        for_each_line(
+            text,
+            [&record] (const std::string_view line) {
+                split_record(line, '|', record);
+                benchmark::DoNotOptimize(record[record.size() - 1].data());
+            }
+        );
+
+    state.SetBytesProcessed(state.iterations() * text.size());
+    state.SetItemsProcessed(state.iterations() * ROWS);
+}
+
+
+/**
+ * \brief   A whole chunk in one scan, as the pipeline splits its chunks.
+ */
+void BM_SplitIndexedChunk(benchmark::State& state) {
+    const auto& text = chunk_text();
+    ParseArena arena;
+    Record record(&arena);
+
+    for (auto _ : state)
+        split_records(
+            text,
+            '|',
+            record,
+            [] (const Record& record, const std::string_view) {
+                benchmark::DoNotOptimize(record[record.size() - 1].data());
+            }
+        );
+
+    state.SetBytesProcessed(state.iterations() * text.size());
+    state.SetItemsProcessed(state.iterations() * ROWS);
+}
+
+
+
+/**
+ * \brief   Stars through the generic path: every field indexed, then parse_star_record().
+ */
+void BM_ParseStarRecord(benchmark::State& state) {
+    const auto& text = chunk_text();
+    const auto& format = catalog_format("tycho2");
+    ParseArena arena;
+    Record record(&arena);
+
+    for (auto _ : state)
+        for_each_line(
+            text,
+            [&format, &record] (const std::string_view line) {
+                split_record(line, format.delimiter, record);
+                uint8_t sources;
+                const auto star = parse_star_record(record, format, &sources);
+                benchmark::DoNotOptimize(star.mag);
+            }
+        );
+
+    state.SetBytesProcessed(state.iterations() * text.size());
+    state.SetItemsProcessed(state.iterations() * ROWS);
+}
+
+
+/**
+ * \brief   Stars through the parser generated from the Tycho-2 column schema.
+ */
+void BM_ParseStarSchema(benchmark::State& state) {
+    const auto& text = chunk_text();
+    const auto& format = catalog_format("tycho2");
+
+    for (auto _ : state)
+        for_each_line(
+            text,
+            [&format] (const std::string_view line) {
+                uint8_t sources;
+                const auto star = format.fixed_star_parser(line, format.delimiter, sources);
+                benchmark::DoNotOptimize(star.mag);
+            }
+        );
+
+    state.SetBytesProcessed(state.iterations() * text.size());
+    state.SetItemsProcessed(state.iterations() * ROWS);
+}
+
+}
+
+
+BENCHMARK(BM_SplitCopying)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SplitIndexedLines)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SplitIndexedChunk)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ParseStarRecord)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ParseStarSchema)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <benchmark/benchmark.h>
+
+#include "catalog.hpp"
+#include "pipeline.hpp"
+#include "synthetic_catalog.hpp"
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+
+std::atomic<std::size_t> heap_allocations{0};
+
+
+constexpr std::size_t ROWS = 200000;
+
+
+/**
+ * \brief   Synthetic Tycho-2 rows in the temporary directory, one in ten with a blank BT.
+ */
+class AllocationCatalog {
+    public:
+        AllocationCatalog():
+                path((fs::temp_directory_path() / "starfinder_bench_allocations.dat").string())
+        {
+            SyntheticCatalogOptions options;
+            options.rows = ROWS;
+            options.blank_bt_fraction = 0.1;
+            options.blank_vt_fraction = 0;
+            options.malformed_fraction = 0;
+            write_synthetic_catalog(path, options);
+        }
+
+        ~AllocationCatalog() {
+            std::remove(path.c_str());
+        }
+
+        const std::string path;
+};
+
+
+const AllocationCatalog& allocation_catalog() {
+    static const AllocationCatalog catalog;
+    return catalog;
+}
+
+
+/**
+ * \brief   Heap allocations per row of the sequential reader.
+ */
+void BM_ParseAllocationsSequential(benchmark::State& state) {
+    const auto& catalog = allocation_catalog();
+    std::size_t allocations = 0;
+
+    for (auto _ : state) {
+        const auto before = heap_allocations.load();
+        const auto skipped = read_star_blocks(
+            catalog.path,
+            catalog_format("tycho2"),
+            STAR_BLOCK_ROWS,
+            [] (const StarColumns& block) {
+                benchmark::DoNotOptimize(block.mag.data());
+            }
+        );
+        allocations = heap_allocations.load() - before;
+        benchmark::DoNotOptimize(skipped);
+    }
+
+    state.counters["allocations_per_row"] = static_cast<double>(allocations) / ROWS;
+    state.SetItemsProcessed(state.iterations() * ROWS);
+}
+
+
+/**
+ * \brief   Heap allocations per row of the read/parse pipeline, including its chunks and batches.
+ */
+void BM_ParseAllocationsPipeline(benchmark::State& state) {
+    const auto& catalog = allocation_catalog();
+    PipelineOptions options;
+    options.parser_threads = state.range(0);
+    std::size_t allocations = 0;
+
+    for (auto _ : state) {
+        const auto before = heap_allocations.load();
+        const auto skipped = pipeline_star_blocks(
+            catalog.path,
+            catalog_format("tycho2"),
+            std::nullopt,
+            options,
+            [] (const StarColumns& block) {
+                benchmark::DoNotOptimize(block.mag.data());
+            }
+        );
+        allocations = heap_allocations.load() - before;
+        benchmark::DoNotOptimize(skipped);
+    }
+
+    state.counters["allocations_per_row"] = static_cast<double>(allocations) / ROWS;
+    state.SetItemsProcessed(state.iterations() * ROWS);
+}
+
+}
+
+
+// Count every heap allocation of the benchmark binary. The array, nothrow and
+// sized forms of the standard library forward to these; the aligned forms
+// do not, so they are replaced too, over aligned_alloc(), which free() releases
+void* operator new(const std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size != 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+
+void* operator new(
+        const std::size_t size,
+        const std::align_val_t alignment
+) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    // aligned_alloc() takes a multiple of the alignment
+    const auto align = static_cast<std::size_t>(alignment);
+    const auto bytes = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+    if (void* p = std::aligned_alloc(align, bytes))
+        return p;
+    throw std::bad_alloc();
+}
+
+
+// GCC inlines these into new-expressions and then takes the free() for a
+// mismatch with the replaced operator new it can not see into
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+
+BENCHMARK(BM_ParseAllocationsSequential)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ParseAllocationsPipeline)->Arg(1)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,132 @@
+#include <memory>
+#include <string>
+#include <benchmark/benchmark.h>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream.hpp>
+
+#include "catalog.hpp"
+#include "log.hpp"
+#include "synthetic_catalog.hpp"
+
+
+namespace {
+
+constexpr char ROW[] =
+    "0001 00008 1| |  2.31750494|  2.23184345|  -16.3|   -9.0| 68| 73| 1.7| 1.8|1958.89|1951.94| 4|1.0|1.0|0.9|1.0"
+    "|12.146|0.158|12.146|0.223|999| |         |  2.31754222|  2.23186444|1.67|1.54| 88.0|100.8| |-0.2";
+
+/// The same row with a blank BT
+constexpr char ROW_WITHOUT_BT[] =
+    "0001 00008 1| |  2.31750494|  2.23184345|  -16.3|   -9.0| 68| 73| 1.7| 1.8|1958.89|1951.94| 4|1.0|1.0|0.9|1.0"
+    "|      |     |12.146|0.223|999| |         |  2.31754222|  2.23186444|1.67|1.54| 88.0|100.8| |-0.2";
+
+/// Rows of the in-memory catalog
+constexpr std::size_t CATALOG_ROWS = 200000;
+
+
+/**
+ * \brief   Logs errors only while alive, for functions that print their progress.
+ */
+class QuietLog {
+    public:
+        QuietLog() {
+            set_log_level(LogLevel::error);
+        }
+
+        ~QuietLog() {
+            set_log_level(LogLevel::progress);
+        }
+};
+
+
+/**
+ * \brief   Synthetic Tycho-2 rows, one in ten with a blank BT.
+ */
+const std::string& catalog_text() {
+    static const std::string text = [] {
+        SyntheticCatalogOptions options;
+        options.blank_bt_fraction = 0.1;
+        options.blank_vt_fraction = 0;
+        options.malformed_fraction = 0;
+        return synthetic_catalog_rows(options, 0, CATALOG_ROWS);
+    }();
+    return text;
+}
+
+
+void BM_ParseField(benchmark::State& state) {
+    const std::string line = ROW;
+    Record record;
+    split_record(line, '|', record);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(parse_field(record, 24, "RA"));
+
+    state.counters["fields"] = benchmark::Counter(1, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+
+/**
+ * \param   state   range(0) is 1 for a row with a blank BT
+ */
+void BM_ParseMagnitude(benchmark::State& state) {
+    const std::string line = state.range(0) != 0 ? ROW_WITHOUT_BT : ROW;
+    Record record;
+    split_record(line, '|', record);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(parse_magnitude(record));
+
+    state.counters["rows"] = benchmark::Counter(1, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+
+/**
+ * \brief   parse_star_record() on a row that is already split.
+ */
+void BM_ParseStarRecordFields(benchmark::State& state) {
+    const std::string line = ROW;
+    const auto& format = catalog_format("tycho2");
+    Record record;
+    split_record(line, '|', record);
+
+    for (auto _ : state) {
+        uint8_t sources;
+        const auto star = parse_star_record(record, format, &sources);
+        benchmark::DoNotOptimize(star.mag);
+    }
+
+    state.counters["rows"] = benchmark::Counter(1, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+
+/**
+ * \brief   read_stars() on a catalog in memory, for the whole sky or a 10 degree Dec band.
+ *
+ * \param   state   range(0) is the Dec band width in degrees
+ */
+void BM_ReadStars(benchmark::State& state) {
+    namespace io = boost::iostreams;
+
+    const auto& text = catalog_text();
+    const StarFilter filter{0, 360, -90, -90 + static_cast<double>(state.range(0)), 13};
+    std::size_t stars = 0;
+
+    for (auto _ : state) {
+        const QuietLog quiet;
+        auto input = std::make_unique<io::stream<io::array_source>>(text.data(), text.size());
+        stars = read_stars(std::move(input), catalog_format("tycho2"), filter).size();
+    }
+
+    state.counters["rows"] = benchmark::Counter(CATALOG_ROWS, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["stars"] = benchmark::Counter(stars, benchmark::Counter::kIsIterationInvariantRate);
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+}
+
+
+BENCHMARK(BM_ParseField);
+BENCHMARK(BM_ParseMagnitude)->Arg(0)->Arg(1);
+BENCHMARK(BM_ParseStarRecordFields);
+BENCHMARK(BM_ReadStars)->Arg(180)->Arg(10)->Unit(benchmark::kMillisecond);
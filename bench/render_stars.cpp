@@ -0,0 +1,61 @@
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "sky_stars.hpp"
+#include "star_render.hpp"
+
+
+namespace {
+
+/**
+ * \brief   render_stars() of the full sky in catalog order.
+ *
+ * \param   state   range(0) by range(1) pixels, range(2) stars
+ */
+void BM_RenderStars(benchmark::State& state) {
+    const auto stars = sky_stars(state.range(2));
+    cv::Mat img;
+
+    for (auto _ : state) {
+        render_stars(stars, StarOrder::catalog, state.range(0), state.range(1), 0, 360, -90, 90, std::nullopt, CV_8U, img);
+        benchmark::ClobberMemory();
+    }
+
+    state.counters["stars"] = benchmark::Counter(stars.size(), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+
+/**
+ * \brief   render_stars() of a million stars into a 4096×2048 image of each pixel depth.
+ *
+ * \param   state   range(0) OpenCV depth
+ */
+void BM_RenderStarsDepth(benchmark::State& state) {
+    const auto stars = sky_stars(1000000);
+    cv::Mat img;
+    state.SetLabel(pixel_depth_name(state.range(0)));
+
+    for (auto _ : state) {
+        render_stars(stars, StarOrder::catalog, 4096, 2048, 0, 360, -90, 90, std::nullopt, state.range(0), img);
+        benchmark::ClobberMemory();
+    }
+
+    state.counters["stars"] = benchmark::Counter(stars.size(), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+}
+
+
+BENCHMARK(BM_RenderStars)
+    ->Args({800, 600, 10000})
+    ->Args({800, 600, 1000000})
+    ->Args({4096, 2048, 1000000})
+    ->Args({16384, 8192, 1000000})
+    ->Args({16384, 8192, 2539913})
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_RenderStarsDepth)
+    ->Arg(CV_8U)
+    ->Arg(CV_16U)
+    ->Arg(CV_32F)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+
+#include "shared_catalog.hpp"
+#include "sky_stars.hpp"
+#include "star_cache.hpp"
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+
+/// Tycho-2 sized table
+constexpr std::size_t STARS = 2539913;
+
+
+/**
+ * \brief   A Tycho-2 sized star table, published as a shared segment and saved as a cache file.
+ */
+class PublishedTable {
+    public:
+        PublishedTable():
+                name("starfinder_bench_" + std::to_string(::getpid())),
+                cache_path((fs::temp_directory_path() / (name + ".cache")).string())
+        {
+            StarCache cache;
+            cache.columns.reserve(STARS);
+            for (const auto& star : sky_stars(STARS))
+                cache.columns.push_back(star.ra_deg, star.de_deg, star.mag, 1);
+
+            SharedStarTable::publish(name, cache.columns, 0, std::nullopt, false);
+            save_star_cache(cache_path, {}, std::nullopt, cache);
+        }
+
+        ~PublishedTable() {
+            SharedStarTable::remove(name);
+            std::remove(cache_path.c_str());
+        }
+
+        const std::string name;
+        const std::string cache_path;
+};
+
+
+const PublishedTable& published_table() {
+    static const PublishedTable table;
+    return table;
+}
+
+
+/**
+ * \brief   Start of a worker that loads its own copy of the table from the column cache.
+ */
+void BM_LoadStarCache(benchmark::State& state) {
+    const auto& table = published_table();
+    for (auto _ : state) {
+        const auto cache = load_star_cache(table.cache_path, {}, std::nullopt);
+        benchmark::DoNotOptimize(cache->columns.mag.data());
+    }
+    state.SetItemsProcessed(state.iterations() * STARS);
+}
+
+
+/**
+ * \brief   Start of a worker that maps the published table, and its first pass over the magnitudes.
+ */
+void BM_AttachSharedTable(benchmark::State& state) {
+    const auto& table = published_table();
+    for (auto _ : state) {
+        const auto shared = SharedStarTable::attach(table.name);
+        const auto columns = shared.columns();
+        double sum = 0;
+        for (std::size_t i = 0; i < columns.size(); i++)
+            sum += columns.mag[i];
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * STARS);
+}
+
+}
+
+
+BENCHMARK(BM_LoadStarCache)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AttachSharedTable)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,15 @@
+#include "sky_stars.hpp"
+
+#include <cmath>
+#include <random>
+
+
+std::vector<Star> sky_stars(const std::size_t count) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> ra(0, 360), sin_de(-1, 1), mag(-1, 12);
+    std::vector<Star> stars;
+    stars.reserve(count);
+    for (std::size_t i = 0; i < count; i++)
+        stars.emplace_back(ra(rng), std::asin(sin_de(rng)) * 180 / M_PI, mag(rng));
+    return stars;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "star.hpp"
+
+
+/**
+ * \brief   Stars spread evenly over the sky in random order, with magnitudes from -1 to 12.
+ *
+ * The same count gives the same stars every time.
+ */
+std::vector<Star> sky_stars(const std::size_t count);
@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <benchmark/benchmark.h>
+
+#include "curve_order.hpp"
+
+
+namespace {
+
+/// Output size where the framebuffer (128 MiB) is far larger than the caches
+constexpr uint32_t WIDTH = 16384;
+constexpr uint32_t HEIGHT = 8192;
+
+/// Stars of Tycho-2
+constexpr std::size_t STARS = 2539913;
+
+/// Declination zones of the Guide Star Catalog, which Tycho-2 rows are grouped by
+constexpr int GSC_ZONES = 24;
+constexpr int GSC_REGIONS = 9537;
+
+
+/**
+ * \brief   A star projected onto the full-sky output image.
+ */
+struct Dot {
+    uint64_t index;
+    uint32_t x;
+    uint32_t y;
+    uint8_t brightness;
+};
+
+
+/**
+ * \brief   Stars in Tycho-2 row order: GSC regions one after the other, in random order within a region.
+ *
+ * Regions are bands of 7.5 degrees in Dec, cut into RA sections of about
+ * equal area; stars are spread evenly over the sky.
+ */
+const std::vector<Dot>& gsc_stars() {
+    static const std::vector<Dot> stars = [] {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<double> unit(0, 1);
+        std::uniform_int_distribution<int> brightness(0, 255);
+
+        std::vector<Dot> dots;
+        dots.reserve(STARS);
+        const double zone_height = 180.0 / GSC_ZONES;
+        for (int zone = 0; zone < GSC_ZONES; zone++) {
+            const double min_dec = -90 + zone * zone_height;
+            const double area = std::sin((min_dec + zone_height) * M_PI / 180) - std::sin(min_dec * M_PI / 180);
+            const int regions = std::max(1, static_cast<int>(std::lround(GSC_REGIONS * area / 2)));
+            const auto zone_stars = static_cast<std::size_t>(STARS * area / 2);
+            for (int region = 0; region < regions; region++) {
+                for (std::size_t i = 0; i < zone_stars / regions; i++) {
+                    const double ra = (region + unit(rng)) * 360 / regions;
+                    const double dec = std::asin(std::sin(min_dec * M_PI / 180) + unit(rng) * area) * 180 / M_PI;
+                    dots.push_back(Dot{
+                        0,
+                        std::min<uint32_t>(WIDTH - 1, static_cast<uint32_t>(ra / 360 * WIDTH)),
+                        std::min<uint32_t>(HEIGHT - 1, static_cast<uint32_t>((dec + 90) / 180 * HEIGHT)),
+                        static_cast<uint8_t>(brightness(rng))
+                    });
+                }
+            }
+        }
+        return dots;
+    }();
+    return stars;
+}
+
+
+/**
+ * \brief   The same stars in random order, the worst case for the framebuffer.
+ */
+const std::vector<Dot>& shuffled_stars() {
+    static const std::vector<Dot> stars = [] {
+        auto dots = gsc_stars();
+        std::shuffle(dots.begin(), dots.end(), std::mt19937(2));
+        return dots;
+    }();
+    return stars;
+}
+
+
+void sort_along_curve(
+        std::vector<Dot>& dots,
+        const StarOrder order
+) {
+    const auto bits = curve_bits(WIDTH, HEIGHT);
+    for (auto& dot : dots)
+        dot.index = curve_index(order, dot.x, dot.y, bits);
+    std::stable_sort(
+        dots.begin(),
+        dots.end(),
+        [] (const Dot& a, const Dot& b) {
+            return a.index < b.index;
+        }
+    );
+}
+
+
+/**
+ * \brief   Plots stars that are already in the given order, as render_stars() does after sorting.
+ */
+void BM_PlotStars(
+        benchmark::State& state,
+        const std::vector<Dot>& (*stars)(),
+        const StarOrder order
+) {
+    auto dots = stars();
+    sort_along_curve(dots, order);
+    std::vector<uint8_t> frame(std::size_t(WIDTH) * HEIGHT);
+
+    for (auto _ : state) {
+        for (const auto& dot : dots)
+            frame[std::size_t(dot.y) * WIDTH + dot.x] = dot.brightness;
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * dots.size());
+}
+
+
+/**
+ * \brief   Cost of putting the stars in order, paid once per render.
+ */
+void BM_SortAlongCurve(
+        benchmark::State& state,
+        const StarOrder order
+) {
+    const auto& stars = gsc_stars();
+    std::vector<Dot> dots;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        dots = stars;
+        state.ResumeTiming();
+        sort_along_curve(dots, order);
+        benchmark::DoNotOptimize(dots.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * stars.size());
+}
+
+}
+
+
+BENCHMARK_CAPTURE(BM_PlotStars, gsc_catalog, gsc_stars, StarOrder::catalog)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_PlotStars, gsc_morton, gsc_stars, StarOrder::morton)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_PlotStars, gsc_hilbert, gsc_stars, StarOrder::hilbert)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_PlotStars, shuffled_catalog, shuffled_stars, StarOrder::catalog)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_SortAlongCurve, morton, StarOrder::morton)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_SortAlongCurve, hilbert, StarOrder::hilbert)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,252 @@
+#include "apparent.hpp"
+
+#include <cmath>
+
+
+namespace {
+
+constexpr double DEG_TO_RAD = M_PI / 180;
+constexpr double RAD_TO_DEG = 180 / M_PI;
+constexpr double ARCSEC_TO_RAD = DEG_TO_RAD / 3600;
+constexpr double JD_J2000 = 2451545.0;
+constexpr double DAYS_PER_CENTURY = 36525.0;
+
+/// Constant of annual aberration
+constexpr double ANNUAL_ABERRATION = 20.49552 * ARCSEC_TO_RAD;
+/// Equatorial rotation speed of the Earth in units of c
+constexpr double DIURNAL_ABERRATION = 0.3200 * ARCSEC_TO_RAD;
+/// Obliquity of the ecliptic at J2000.0
+constexpr double OBLIQUITY_J2000 = 84381.406 * ARCSEC_TO_RAD;
+
+
+using Matrix = double[3][3];
+
+
+void multiply(
+        const Matrix& a,
+        const Matrix& b,
+        Matrix& result
+) {
+    Matrix tmp;
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            tmp[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j];
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            result[i][j] = tmp[i][j];
+}
+
+
+/**
+ * \brief   result = Rx(angle) * result
+ */
+void rotate_x(
+        const double angle,
+        Matrix& result
+) {
+    const double s = std::sin(angle);
+    const double c = std::cos(angle);
+    const Matrix r = {
+        {1, 0, 0},
+        {0, c, s},
+        {0, -s, c}
+    };
+    multiply(r, result, result);
+}
+
+
+/**
+ * \brief   result = Rz(angle) * result
+ */
+void rotate_z(
+        const double angle,
+        Matrix& result
+) {
+    const double s = std::sin(angle);
+    const double c = std::cos(angle);
+    const Matrix r = {
+        {c, s, 0},
+        {-s, c, 0},
+        {0, 0, 1}
+    };
+    multiply(r, result, result);
+}
+
+
+/**
+ * \brief   Bias-precession-nutation matrix, GCRS to true equator and equinox of date.
+ */
+void bias_precession_nutation(
+        const double t,
+        Matrix& result
+) {
+    // IAU 2006 Fukushima-Williams angles, including frame bias
+    const double gamma = (-0.052928 + (10.556378 + (0.4932044 + (-0.00031238 + (-0.000002788 + 0.0000000260 * t) * t) * t) * t) * t) * ARCSEC_TO_RAD;
+    const double phi = (84381.412819 + (-46.811016 + (0.0511268 + (0.00053289 + (-0.000000440 - 0.0000000176 * t) * t) * t) * t) * t) * ARCSEC_TO_RAD;
+    const double psi = (-0.041775 + (5038.481484 + (1.5584175 + (-0.00018522 + (-0.000026452 - 0.0000000148 * t) * t) * t) * t) * t) * ARCSEC_TO_RAD;
+    const double eps = (84381.406 + (-46.836769 + (-0.0001831 + (0.00200340 + (-0.000000576 - 0.0000000434 * t) * t) * t) * t) * t) * ARCSEC_TO_RAD;
+
+    // Leading terms of the IAU 1980 nutation
+    const double omega = (125.04452 - 1934.136261 * t) * DEG_TO_RAD;
+    const double sun = (280.4665 + 36000.7698 * t) * DEG_TO_RAD;
+    const double moon = (218.3165 + 481267.8813 * t) * DEG_TO_RAD;
+    const double dpsi = (-17.20 * std::sin(omega) - 1.32 * std::sin(2 * sun) - 0.23 * std::sin(2 * moon) + 0.21 * std::sin(2 * omega)) * ARCSEC_TO_RAD;
+    const double deps = (9.20 * std::cos(omega) + 0.57 * std::cos(2 * sun) + 0.10 * std::cos(2 * moon) - 0.09 * std::cos(2 * omega)) * ARCSEC_TO_RAD;
+
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            result[i][j] = (i == j) ? 1 : 0;
+    rotate_z(gamma, result);
+    rotate_x(phi, result);
+    rotate_z(-(psi + dpsi), result);
+    rotate_x(-(eps + deps), result);
+}
+
+
+/**
+ * \brief   Barycentric velocity of the Earth in units of c, GCRS axes.
+ */
+void earth_velocity(
+        const double t,
+        double (&velocity)[3]
+) {
+    // Low-precision solar theory, referred to the ecliptic of J2000
+    const double mean_longitude = 280.46646 + 36000.76983 * t;
+    const double mean_anomaly = (357.52911 + 35999.05029 * t) * DEG_TO_RAD;
+    const double center =
+        (1.914602 - 0.004817 * t) * std::sin(mean_anomaly)
+        + (0.019993 - 0.000101 * t) * std::sin(2 * mean_anomaly)
+        + 0.000289 * std::sin(3 * mean_anomaly);
+    const double sun_longitude = (mean_longitude + center - 1.397 * t) * DEG_TO_RAD;
+    const double eccentricity = 0.016708634 - 0.000042037 * t;
+    const double perihelion = (102.93735 + 1.71946 * t) * DEG_TO_RAD;
+
+    const double x = ANNUAL_ABERRATION * (std::sin(sun_longitude) - eccentricity * std::sin(perihelion));
+    const double y = ANNUAL_ABERRATION * (-std::cos(sun_longitude) + eccentricity * std::cos(perihelion));
+
+    velocity[0] = x;
+    velocity[1] = y * std::cos(OBLIQUITY_J2000);
+    velocity[2] = y * std::sin(OBLIQUITY_J2000);
+}
+
+}
+
+
+double julian_epoch_to_jd(const double epoch) {
+    return JD_J2000 + (epoch - 2000) * 365.25;
+}
+
+
+ApparentTransform make_apparent_transform(
+        const double jd_tt,
+        const std::optional<Observer>& observer
+) {
+    const double t = (jd_tt - JD_J2000) / DAYS_PER_CENTURY;
+
+    ApparentTransform transform;
+    bias_precession_nutation(t, transform.rotation);
+
+    double velocity[3];
+    earth_velocity(t, velocity);
+
+    // Annual aberration is applied before the rotation, so rotate the velocity instead
+    for (int i = 0; i < 3; i++)
+        transform.offset[i] =
+            transform.rotation[i][0] * velocity[0]
+            + transform.rotation[i][1] * velocity[1]
+            + transform.rotation[i][2] * velocity[2];
+
+    if (observer) {
+        // Local sidereal time; UT1 is taken equal to TT, which is well within the accuracy needed here
+        const double d = jd_tt - JD_J2000;
+        const double gmst = 280.46061837 + 360.98564736629 * d;
+        const double lst = (gmst + observer->lon_deg) * DEG_TO_RAD;
+        const double speed = DIURNAL_ABERRATION * std::cos(observer->lat_deg * DEG_TO_RAD);
+        transform.offset[0] += -speed * std::sin(lst);
+        transform.offset[1] += speed * std::cos(lst);
+    }
+
+    return transform;
+}
+
+
+void to_unit_vectors(
+        const StarColumns& src,
+        UnitVectorColumns& dst
+) {
+    const std::size_t count = src.size();
+    dst.resize(count);
+
+    const double* __restrict ra = src.ra_deg.data();
+    const double* __restrict de = src.de_deg.data();
+    double* __restrict x = dst.x.data();
+    double* __restrict y = dst.y.data();
+    double* __restrict z = dst.z.data();
+
+    for (std::size_t i = 0; i < count; i++) {
+        const double a = ra[i] * DEG_TO_RAD;
+        const double d = de[i] * DEG_TO_RAD;
+        const double cos_d = std::cos(d);
+        x[i] = cos_d * std::cos(a);
+        y[i] = cos_d * std::sin(a);
+        z[i] = std::sin(d);
+    }
+}
+
+
+void from_unit_vectors(
+        const UnitVectorColumns& src,
+        StarColumns& dst
+) {
+    const std::size_t count = src.size();
+    dst.ra_deg.resize(count);
+    dst.de_deg.resize(count);
+
+    const double* __restrict x = src.x.data();
+    const double* __restrict y = src.y.data();
+    const double* __restrict z = src.z.data();
+    double* __restrict ra = dst.ra_deg.data();
+    double* __restrict de = dst.de_deg.data();
+
+    for (std::size_t i = 0; i < count; i++) {
+        const double a = std::atan2(y[i], x[i]) * RAD_TO_DEG;
+        ra[i] = a < 0 ? a + 360 : a;
+        de[i] = std::atan2(z[i], std::hypot(x[i], y[i])) * RAD_TO_DEG;
+    }
+}
+
+
+void transform_unit_vectors(
+        const ApparentTransform& transform,
+        UnitVectorColumns& vectors
+) {
+    const std::size_t count = vectors.size();
+    double* __restrict x = vectors.x.data();
+    double* __restrict y = vectors.y.data();
+    double* __restrict z = vectors.z.data();
+
+    // Local copy, so the compiler knows the coefficients do not alias the columns
+    const ApparentTransform t = transform;
+    const auto& m = t.rotation;
+    const auto& b = t.offset;
+    for (std::size_t i = 0; i < count; i++) {
+        const double u = m[0][0] * x[i] + m[0][1] * y[i] + m[0][2] * z[i] + b[0];
+        const double v = m[1][0] * x[i] + m[1][1] * y[i] + m[1][2] * z[i] + b[1];
+        const double w = m[2][0] * x[i] + m[2][1] * y[i] + m[2][2] * z[i] + b[2];
+        const double inv_norm = 1 / std::sqrt(u * u + v * v + w * w);
+        x[i] = u * inv_norm;
+        y[i] = v * inv_norm;
+        z[i] = w * inv_norm;
+    }
+}
+
+
+void apply_apparent_place(
+        const ApparentTransform& transform,
+        StarColumns& columns
+) {
+    UnitVectorColumns vectors;
+    to_unit_vectors(columns, vectors);
+    transform_unit_vectors(transform, vectors);
+    from_unit_vectors(vectors, columns);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <optional>
+
+#include "star_columns.hpp"
+
+
+/**
+ * \brief   Geographic position of the observer, used for diurnal aberration.
+ */
+struct Observer {
+    double lat_deg;
+    double lon_deg;
+};
+
+
+/**
+ * \brief   ICRS to apparent place transform for one epoch.
+ *
+ * The apparent direction is R * (u + beta) renormalized, where R is the
+ * bias-precession-nutation matrix and beta is the observer velocity in units
+ * of c. Both are folded into one matrix and one offset vector, so every star
+ * costs a single 3x3 matrix-vector product.
+ */
+struct ApparentTransform {
+    double rotation[3][3];
+    double offset[3];
+};
+
+
+/**
+ * \brief   Converts a Julian epoch (e.g. 2025.5) to a Julian date.
+ */
+double julian_epoch_to_jd(const double epoch);
+
+
+/**
+ * \brief   Builds the apparent place transform for the given date.
+ *
+ * Uses IAU 2006 precession (Fukushima-Williams angles, frame bias included),
+ * the leading terms of the IAU 1980 nutation and first-order annual aberration
+ * from a low-precision solar theory; diurnal aberration is added when the
+ * observer is known. Light deflection is ignored. The result is accurate to
+ * about half an arcsecond.
+ *
+ * \param   jd_tt       Julian date, TT
+ * \param   observer    observer position, or nothing for a geocentric place
+ */
+ApparentTransform make_apparent_transform(
+        const double jd_tt,
+        const std::optional<Observer>& observer
+);
+
+
+/**
+ * \brief   Converts RA/Dec columns to unit vectors.
+ */
+void to_unit_vectors(
+        const StarColumns& src,
+        UnitVectorColumns& dst
+);
+
+
+/**
+ * \brief   Converts unit vectors back to RA/Dec columns; magnitudes are left untouched.
+ */
+void from_unit_vectors(
+        const UnitVectorColumns& src,
+        StarColumns& dst
+);
+
+
+/**
+ * \brief   Applies the transform to unit vectors in place.
+ *
+ * Plain multiply-add over three columns, vectorized by the compiler.
+ */
+void transform_unit_vectors(
+        const ApparentTransform& transform,
+        UnitVectorColumns& vectors
+);
+
+
+/**
+ * \brief   Replaces ICRS positions with apparent places.
+ */
+void apply_apparent_place(
+        const ApparentTransform& transform,
+        StarColumns& columns
+);
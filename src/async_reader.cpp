@@ -0,0 +1,539 @@
+#include "async_reader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <boost/format.hpp>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+namespace {
+
+constexpr std::pair<ReadBackend, const char*> BACKEND_NAMES[] = {
+    {ReadBackend::automatic, "auto"},
+    {ReadBackend::io_uring, "io_uring"},
+    {ReadBackend::pread, "pread"},
+};
+
+
+std::runtime_error system_error(
+        const std::string& what,
+        const std::string& path,
+        const int error
+) {
+    return std::runtime_error(
+        (
+            boost::format("%1% %2%: %3%") % what % path % std::strerror(error)
+        ).str()
+    );
+}
+
+
+/**
+ * \brief   Owns a file descriptor.
+ */
+class FileDescriptor {
+    public:
+        explicit FileDescriptor(const int fd) noexcept: fd(fd) {}
+
+        ~FileDescriptor() {
+            if (fd >= 0)
+                ::close(fd);
+        }
+
+        FileDescriptor(const FileDescriptor&) = delete;
+        FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+        const int fd;
+};
+
+
+/**
+ * \brief   One block of the file and the buffer it is read into.
+ */
+struct Slot {
+    std::unique_ptr<char[]> buffer;
+    iovec iov;
+    std::uint64_t offset = 0;
+    std::size_t length = 0;
+    std::size_t filled = 0;
+    bool done = false;
+};
+
+
+/**
+ * \brief   Thrown when the kernel refuses to set up an io_uring.
+ */
+class IoUringUnavailable: public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+};
+
+
+/**
+ * \brief   Minimal io_uring on the raw system calls, with just enough to queue reads.
+ *
+ * Submissions are batched until enter() is called, which submits them and
+ * optionally waits for completions.
+ */
+class IoUring {
+    public:
+        explicit IoUring(const unsigned entries);
+
+        ~IoUring();
+
+        IoUring(const IoUring&) = delete;
+        IoUring& operator=(const IoUring&) = delete;
+
+        void prepare_readv(
+                const int fd,
+                const iovec* iov,
+                const std::uint64_t offset,
+                const std::uint64_t user_data
+        ) noexcept;
+
+        /**
+         * \brief   Submits the prepared requests and waits for at least min_complete completions.
+         */
+        void enter(const unsigned min_complete);
+
+        /**
+         * \return  false if the completion queue is empty
+         */
+        bool pop_completion(
+                std::uint64_t& user_data,
+                int& result
+        ) noexcept;
+
+    private:
+        int fd;
+        io_uring_params params;
+        void* sq_ring = MAP_FAILED;
+        std::size_t sq_ring_bytes = 0;
+        void* cq_ring = MAP_FAILED;
+        std::size_t cq_ring_bytes = 0;
+        io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        std::size_t sqes_bytes = 0;
+        unsigned prepared = 0;
+
+        void release() noexcept;
+
+        unsigned* sq_field(const unsigned offset) const noexcept {
+            return reinterpret_cast<unsigned*>(static_cast<char*>(sq_ring) + offset);
+        }
+
+        unsigned* cq_field(const unsigned offset) const noexcept {
+            return reinterpret_cast<unsigned*>(static_cast<char*>(cq_ring) + offset);
+        }
+};
+
+
+IoUring::IoUring(const unsigned entries) {
+    std::memset(&params, 0, sizeof(params));
+    fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+        throw IoUringUnavailable(
+            (
+                boost::format("io_uring is not available: %1%") % std::strerror(errno)
+            ).str()
+        );
+
+    sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        sq_ring_bytes = cq_ring_bytes = std::max(sq_ring_bytes, cq_ring_bytes);
+
+    sq_ring = ::mmap(nullptr, sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring != MAP_FAILED) {
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            cq_ring = sq_ring;
+        else
+            cq_ring = ::mmap(nullptr, cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+    sqes_bytes = params.sq_entries * sizeof(io_uring_sqe);
+    if (cq_ring != MAP_FAILED)
+        sqes = static_cast<io_uring_sqe*>(
+            ::mmap(nullptr, sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES)
+        );
+    if (sqes == MAP_FAILED) {
+        const auto error = errno;
+        release();
+        throw IoUringUnavailable(
+            (
+                boost::format("Failed to map the io_uring: %1%") % std::strerror(error)
+            ).str()
+        );
+    }
+}
+
+
+IoUring::~IoUring() {
+    release();
+}
+
+
+void IoUring::release() noexcept {
+    if (sqes != MAP_FAILED)
+        ::munmap(sqes, sqes_bytes);
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+        ::munmap(cq_ring, cq_ring_bytes);
+    if (sq_ring != MAP_FAILED)
+        ::munmap(sq_ring, sq_ring_bytes);
+    sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    cq_ring = sq_ring = MAP_FAILED;
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+
+void IoUring::prepare_readv(
+        const int file,
+        const iovec* iov,
+        const std::uint64_t offset,
+        const std::uint64_t user_data
+) noexcept {
+    // Only this thread writes the tail, so a relaxed load is enough
+    const auto tail = __atomic_load_n(sq_field(params.sq_off.tail), __ATOMIC_RELAXED);
+    const auto index = tail & *sq_field(params.sq_off.ring_mask);
+
+    auto& sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = file;
+    sqe.addr = reinterpret_cast<std::uint64_t>(iov);
+    sqe.len = 1;
+    sqe.off = offset;
+    sqe.user_data = user_data;
+
+    sq_field(params.sq_off.array)[index] = index;
+    __atomic_store_n(sq_field(params.sq_off.tail), tail + 1, __ATOMIC_RELEASE);
+    prepared++;
+}
+
+
+void IoUring::enter(const unsigned min_complete) {
+    for (;;) {
+        const auto submitted = ::syscall(
+            __NR_io_uring_enter,
+            fd,
+            prepared,
+            min_complete,
+            min_complete != 0 ? IORING_ENTER_GETEVENTS : 0u,
+            nullptr,
+            0
+        );
+        if (submitted >= 0) {
+            prepared -= static_cast<unsigned>(submitted);
+            if (prepared == 0 || min_complete != 0)
+                return;
+        } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            throw std::runtime_error(
+                (
+                    boost::format("io_uring_enter failed: %1%") % std::strerror(errno)
+                ).str()
+            );
+        }
+    }
+}
+
+
+bool IoUring::pop_completion(
+        std::uint64_t& user_data,
+        int& result
+) noexcept {
+    const auto head_ptr = cq_field(params.cq_off.head);
+    const auto head = *head_ptr;
+    if (head == __atomic_load_n(cq_field(params.cq_off.tail), __ATOMIC_ACQUIRE))
+        return false;
+
+    const auto cqes = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cq_ring) + params.cq_off.cqes);
+    const auto& cqe = cqes[head & *cq_field(params.cq_off.ring_mask)];
+    user_data = cqe.user_data;
+    result = cqe.res;
+    __atomic_store_n(head_ptr, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+
+/**
+ * \brief   Splits [offset, size) into blocks and hands out one slot per block in flight.
+ */
+class BlockPlan {
+    public:
+        BlockPlan(
+                    const std::uint64_t offset,
+                    const std::uint64_t size,
+                    const AsyncReadOptions& options
+        ):
+                offset(offset),
+                size(size),
+                block_bytes(std::max<std::size_t>(options.block_bytes, 1)),
+                blocks(size > offset ? (size - offset + block_bytes - 1) / block_bytes : 0),
+                slots(std::max<std::size_t>(std::min<std::size_t>(options.depth, blocks), 1))
+        {
+            for (auto& slot : slots)
+                slot.buffer.reset(new char[block_bytes]);
+        }
+
+        Slot& slot(const std::size_t block) noexcept {
+            return slots[block % slots.size()];
+        }
+
+        Slot& start(const std::size_t block) noexcept {
+            auto& s = slot(block);
+            s.offset = offset + block * block_bytes;
+            s.length = static_cast<std::size_t>(std::min<std::uint64_t>(block_bytes, size - s.offset));
+            s.filled = 0;
+            s.done = false;
+            return s;
+        }
+
+        std::size_t depth() const noexcept {
+            return slots.size();
+        }
+
+        const std::uint64_t offset;
+        const std::uint64_t size;
+        const std::size_t block_bytes;
+        const std::size_t blocks;
+
+    private:
+        std::vector<Slot> slots;
+};
+
+
+void read_with_io_uring(
+        const std::string& path,
+        const int fd,
+        BlockPlan& plan,
+        IoUring& ring,
+        const std::function<void(const char*, std::size_t)>& consume
+) {
+    std::size_t in_flight = 0;
+    const auto submit = [fd, &ring, &in_flight] (Slot& slot, const std::uint64_t block) {
+        slot.iov.iov_base = slot.buffer.get() + slot.filled;
+        slot.iov.iov_len = slot.length - slot.filled;
+        ring.prepare_readv(fd, &slot.iov, slot.offset + slot.filled, block);
+        in_flight++;
+    };
+
+    try {
+        std::size_t next_submit = 0;
+        for (; next_submit < std::min(plan.blocks, plan.depth()); next_submit++)
+            submit(plan.start(next_submit), next_submit);
+
+        for (std::size_t next_deliver = 0; next_deliver < plan.blocks; next_deliver++) {
+            auto& slot = plan.slot(next_deliver);
+            while (!slot.done) {
+                ring.enter(1);
+
+                std::uint64_t block;
+                int result;
+                while (ring.pop_completion(block, result)) {
+                    in_flight--;
+                    auto& completed = plan.slot(block);
+                    if (result == -EINTR || result == -EAGAIN) {
+                        submit(completed, block);
+                        continue;
+                    }
+                    if (result < 0)
+                        throw system_error("Failed to read", path, -result);
+
+                    completed.filled += static_cast<std::size_t>(result);
+                    if (result == 0 || completed.filled == completed.length)
+                        completed.done = true;
+                    else
+                        submit(completed, block);   // Short read: queue the remainder
+                }
+            }
+
+            consume(slot.buffer.get(), slot.filled);
+
+            if (next_submit < plan.blocks) {
+                submit(plan.start(next_submit), next_submit);
+                next_submit++;
+            }
+        }
+    }
+    catch (...) {
+        // The kernel writes into the slot buffers until the reads complete
+        std::uint64_t block;
+        int result;
+        while (in_flight != 0) {
+            ring.enter(1);
+            while (ring.pop_completion(block, result))
+                in_flight--;
+        }
+        throw;
+    }
+}
+
+
+/**
+ * \brief   Fallback for kernels without io_uring: one pread() thread per block in flight.
+ */
+void read_with_pread(
+        const std::string& path,
+        const int fd,
+        BlockPlan& plan,
+        const std::function<void(const char*, std::size_t)>& consume
+) {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::size_t next_start = 0;
+    std::size_t delivered = 0;
+    bool abort = false;
+    int error = 0;
+
+    const auto work = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            // Stay within `depth` blocks of the consumer, so that slots are not overwritten
+            changed.wait(lock, [&] { return abort || next_start >= plan.blocks || next_start < delivered + plan.depth(); });
+            if (abort || next_start >= plan.blocks)
+                return;
+            const auto block = next_start++;
+            auto& slot = plan.start(block);
+            lock.unlock();
+
+            int failed = 0;
+            while (slot.filled < slot.length) {
+                const auto result = ::pread(fd, slot.buffer.get() + slot.filled, slot.length - slot.filled, slot.offset + slot.filled);
+                if (result < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    failed = errno;
+                    break;
+                }
+                if (result == 0)
+                    break;
+                slot.filled += static_cast<std::size_t>(result);
+            }
+
+            lock.lock();
+            if (failed != 0 && error == 0)
+                error = failed;
+            slot.done = true;
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < plan.depth(); i++)
+        threads.emplace_back(work);
+
+    std::exception_ptr consume_error;
+    try {
+        for (; delivered < plan.blocks; ) {
+            auto& slot = plan.slot(delivered);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return slot.done || error != 0; });
+                if (error != 0)
+                    throw system_error("Failed to read", path, error);
+            }
+
+            consume(slot.buffer.get(), slot.filled);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.done = false;
+            delivered++;
+            changed.notify_all();
+        }
+    }
+    catch (...) {
+        consume_error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        abort = true;
+        changed.notify_all();
+    }
+    for (auto& thread : threads)
+        thread.join();
+    if (consume_error)
+        std::rethrow_exception(consume_error);
+}
+
+}
+
+
+ReadBackend read_backend(const std::string& name) {
+    for (const auto& [backend, backend_name] : BACKEND_NAMES)
+        if (name == backend_name)
+            return backend;
+
+    throw std::runtime_error(
+        (
+            boost::format("Unknown read backend: %1%") % name
+        ).str()
+    );
+}
+
+
+const char* read_backend_name(const ReadBackend backend) noexcept {
+    for (const auto& [b, name] : BACKEND_NAMES)
+        if (b == backend)
+            return name;
+    return "unknown";
+}
+
+
+std::vector<std::string> read_backend_names() {
+    std::vector<std::string> names;
+    for (const auto& [backend, name] : BACKEND_NAMES)
+        names.push_back(name);
+    return names;
+}
+
+
+ReadBackend read_file_blocks(
+        const std::string& path,
+        const std::uint64_t offset,
+        const AsyncReadOptions& options,
+        const std::function<void(const char* data, std::size_t size)>& consume
+) {
+    const FileDescriptor file(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (file.fd < 0)
+        throw system_error("Failed to open", path, errno);
+
+    struct stat status;
+    if (::fstat(file.fd, &status) != 0)
+        throw system_error("Failed to stat", path, errno);
+    ::posix_fadvise(file.fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+
+    BlockPlan plan(offset, static_cast<std::uint64_t>(status.st_size), options);
+
+    if (options.backend != ReadBackend::pread) {
+        std::unique_ptr<IoUring> ring;
+        try {
+            ring = std::make_unique<IoUring>(static_cast<unsigned>(plan.depth()));
+        }
+        catch (const IoUringUnavailable&) {
+            if (options.backend == ReadBackend::io_uring)
+                throw;
+        }
+        if (ring) {
+            read_with_io_uring(path, file.fd, plan, *ring, consume);
+            return ReadBackend::io_uring;
+        }
+    }
+
+    read_with_pread(path, file.fd, plan, consume);
+    return ReadBackend::pread;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+/**
+ * \brief   How a file is read from disk.
+ */
+enum class ReadBackend {
+    /// io_uring if the kernel allows it, pread threads otherwise
+    automatic,
+    /// io_uring submission/completion rings
+    io_uring,
+    /// A pool of threads issuing pread()
+    pread,
+};
+
+
+/**
+ * \throw   std::runtime_error for unknown names
+ */
+ReadBackend read_backend(const std::string& name);
+
+
+const char* read_backend_name(const ReadBackend backend) noexcept;
+
+
+/**
+ * \return  names accepted by read_backend()
+ */
+std::vector<std::string> read_backend_names();
+
+
+/**
+ * \brief   Sizing of the asynchronous reader.
+ */
+struct AsyncReadOptions {
+    ReadBackend backend = ReadBackend::automatic;
+    /// Bytes per read request
+    std::size_t block_bytes = 4 << 20;
+    /// Read requests kept in flight
+    std::size_t depth = 8;
+};
+
+
+/**
+ * \brief   Reads a file from the given offset to its end with many large reads in flight.
+ *
+ * A single synchronous stream keeps at most one small request at the device;
+ * on a cold page cache that leaves an NVMe drive mostly idle. This keeps
+ * `depth` block-sized reads queued, either on an io_uring or on a pool of
+ * pread() threads, and hands the blocks to the caller in file order as they
+ * complete. The buffer passed to consume() is reused once it returns.
+ *
+ * \param   consume     called on the calling thread for every block, in file order
+ * \return  the backend that was used
+ * \throw   std::runtime_error if the file cannot be opened or read, or if
+ *          io_uring was requested but is not available
+ */
+ReadBackend read_file_blocks(
+        const std::string& path,
+        const std::uint64_t offset,
+        const AsyncReadOptions& options,
+        const std::function<void(const char* data, std::size_t size)>& consume
+);
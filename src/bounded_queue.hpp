@@ -0,0 +1,260 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * \brief   Bounded lock-free multi-producer multi-consumer queue.
+ *
+ * Ring buffer of cells with per-cell sequence numbers (D. Vyukov's design):
+ * producers and consumers claim slots with a CAS on their own cursor and never
+ * take a lock. Blocking push()/pop() spin and yield briefly, then sleep on a
+ * condition variable until a pop() frees a slot or a push() (or the last
+ * close()) makes an item available, so a stage waiting on a slow neighbour
+ * does not burn a core. The mutex is only taken while some thread sleeps.
+ *
+ * The queue is closed once all producers have called close(); pop() then
+ * drains the remaining items and returns false.
+ */
+template <class T>
+class BoundedQueue {
+    public:
+        /**
+         * \param   capacity    number of slots, rounded up to a power of two
+         * \param   producers   number of producers that have to close the queue
+         */
+        BoundedQueue(
+                    const std::size_t capacity,
+                    const std::size_t producers = 1
+        );
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        bool try_push(T& value);
+
+        bool try_pop(T& value);
+
+        /**
+         * \brief   Waits for a free slot and moves the value in.
+         */
+        void push(T value);
+
+        /**
+         * \brief   Waits for an item.
+         *
+         * \return  false if the queue is closed and empty
+         */
+        bool pop(T& value);
+
+        /**
+         * \brief   Signals that one producer has finished.
+         */
+        void close() noexcept;
+
+    private:
+        struct Cell {
+            std::atomic<std::size_t> sequence;
+            T value;
+        };
+
+        static std::size_t round_up(const std::size_t capacity) noexcept;
+
+        /**
+         * \return  false once spinning is over and the caller should sleep
+         */
+        static bool backoff(unsigned& attempt) noexcept;
+
+        /**
+         * \brief   Sleeps on the condition until ready() holds; ready() is called under the mutex.
+         */
+        template <class Ready>
+        void sleep(
+                std::condition_variable& condition,
+                std::atomic<std::size_t>& sleepers,
+                Ready ready
+        );
+
+        /**
+         * \brief   Wakes threads sleeping on the condition, if there are any.
+         */
+        void wake(
+                std::condition_variable& condition,
+                const std::atomic<std::size_t>& sleepers,
+                const bool all = false
+        );
+
+        std::vector<Cell> cells;
+        const std::size_t mask;
+        alignas(64) std::atomic<std::size_t> enqueue_position;
+        alignas(64) std::atomic<std::size_t> dequeue_position;
+        alignas(64) std::atomic<std::size_t> open_producers;
+        alignas(64) std::atomic<std::size_t> push_sleepers;
+        std::atomic<std::size_t> pop_sleepers;
+        std::mutex sleep_mutex;
+        std::condition_variable slot_freed;
+        std::condition_variable item_added;
+};
+
+
+template <class T>
+BoundedQueue<T>::BoundedQueue(
+            const std::size_t capacity,
+            const std::size_t producers
+):
+        cells(round_up(capacity)),
+        mask(cells.size() - 1),
+        enqueue_position(0),
+        dequeue_position(0),
+        open_producers(producers),
+        push_sleepers(0),
+        pop_sleepers(0)
+{
+    for (std::size_t i = 0; i < cells.size(); i++)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+
+template <class T>
+std::size_t BoundedQueue<T>::round_up(const std::size_t capacity) noexcept {
+    std::size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+    return size;
+}
+
+
+template <class T>
+bool BoundedQueue<T>::backoff(unsigned& attempt) noexcept {
+    if (++attempt > 64)
+        std::this_thread::yield();
+    return attempt <= 128;
+}
+
+
+template <class T>
+template <class Ready>
+void BoundedQueue<T>::sleep(
+        std::condition_variable& condition,
+        std::atomic<std::size_t>& sleepers,
+        Ready ready
+) {
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    sleepers.fetch_add(1);
+    // Pairs with the fence in wake(): either the waker sees the sleeper, or ready() sees the change
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    condition.wait(lock, ready);
+    sleepers.fetch_sub(1);
+}
+
+
+template <class T>
+void BoundedQueue<T>::wake(
+        std::condition_variable& condition,
+        const std::atomic<std::size_t>& sleepers,
+        const bool all
+) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_relaxed) == 0)
+        return;
+    // Taking the mutex orders the notification after the sleeper's last ready()
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    if (all)
+        condition.notify_all();
+    else
+        condition.notify_one();
+}
+
+
+template <class T>
+bool BoundedQueue<T>::try_push(T& value) {
+    std::size_t position = enqueue_position.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells[position & mask];
+        const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+        if (difference == 0) {
+            if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.value = std::move(value);
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+template <class T>
+bool BoundedQueue<T>::try_pop(T& value) {
+    std::size_t position = dequeue_position.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells[position & mask];
+        const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+        if (difference == 0) {
+            if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                value = std::move(cell.value);
+                cell.sequence.store(position + mask + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = dequeue_position.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+template <class T>
+void BoundedQueue<T>::push(T value) {
+    unsigned attempt = 0;
+    while (!try_push(value)) {
+        if (!backoff(attempt)) {
+            sleep(slot_freed, push_sleepers, [this, &value] { return try_push(value); });
+            break;
+        }
+    }
+    wake(item_added, pop_sleepers);
+}
+
+
+template <class T>
+bool BoundedQueue<T>::pop(T& value) {
+    unsigned attempt = 0;
+    bool popped = false;
+    for (;;) {
+        popped = try_pop(value);
+        if (popped || open_producers.load(std::memory_order_acquire) == 0)
+            break;
+        if (!backoff(attempt)) {
+            sleep(item_added, pop_sleepers, [this, &value, &popped] {
+                popped = try_pop(value);
+                return popped || open_producers.load(std::memory_order_acquire) == 0;
+            });
+            break;
+        }
+    }
+    if (!popped)
+        // Producers may have pushed between the failed pop and the check
+        popped = try_pop(value);
+    if (popped)
+        wake(slot_freed, push_sleepers);
+    return popped;
+}
+
+
+template <class T>
+void BoundedQueue<T>::close() noexcept {
+    if (open_producers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        wake(item_added, pop_sleepers, true);
+}
@@ -0,0 +1,1005 @@
+#include "catalog.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <boost/format.hpp>
+
+#include "compressed_input.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+
+
+namespace {
+
+/**
+ * \brief   NUL-terminated copy of a field, for the C conversion functions.
+ *
+ * Fields are views into the row text, which is not terminated after each
+ * field; a blank last field would let strtod() skip the line end.
+ */
+class FieldText {
+    public:
+        explicit FieldText(const std::string_view field) {
+            if (field.size() < sizeof(buffer)) {
+                field.copy(buffer, field.size());
+                buffer[field.size()] = '\0';
+                text = buffer;
+            } else {
+                long_text.assign(field.data(), field.size());
+                text = long_text.c_str();
+            }
+        }
+
+        const char* c_str() const noexcept {
+            return text;
+        }
+
+    private:
+        char buffer[64];
+        std::string long_text;
+        const char* text;
+};
+
+
+enum class FieldStatus {
+    ok,
+    missing,
+    invalid,
+};
+
+
+/**
+ * \brief   Converts a field like std::stod, without exceptions.
+ *
+ * Out-of-range values count as missing, as they did with std::stod. There is
+ * an overload for each value type of a SchemaField that schema parsers read.
+ *
+ * \param   field   nothing if the row has no such column
+ */
+FieldStatus read_value(
+        const std::optional<std::string_view>& field,
+        double& value
+) noexcept {
+    if (!field)
+        return FieldStatus::missing;
+
+    const FieldText text(*field);
+    const char* begin = text.c_str();
+    char* end;
+    errno = 0;
+    value = std::strtod(begin, &end);
+    if (end == begin)
+        return FieldStatus::invalid;
+    if (errno == ERANGE)
+        return FieldStatus::missing;
+    return FieldStatus::ok;
+}
+
+
+std::optional<std::string_view> record_field(
+        const Record& record,
+        const size_t index
+) noexcept {
+    if (index >= record.size())
+        return std::nullopt;
+    return record[index];
+}
+
+
+/**
+ * \throw   std::runtime_error if the field is missing or not a number
+ */
+template<typename Type = double>
+Type convert_field(
+        const std::optional<std::string_view>& field,
+        const std::string& field_name
+) {
+    Type value;
+    switch (read_value(field, value)) {
+        case FieldStatus::missing:
+            throw std::runtime_error(
+                (
+                    boost::format("Missing field: %1%") % field_name
+                ).str()
+            );
+        case FieldStatus::invalid:
+            throw std::runtime_error(
+                (
+                    boost::format("Failed to parse %1%. stod") % field_name
+                ).str()
+            );
+        default:
+            return value;
+    }
+}
+
+
+template<typename Type = double>
+std::optional<Type> convert_optional_field(const std::optional<std::string_view>& field) noexcept {
+    Type value;
+    if (read_value(field, value) != FieldStatus::ok)
+        return std::nullopt;
+    return value;
+}
+
+
+/**
+ * \brief   Derives V from Tycho BT/VT magnitudes, falling back to whichever one is present.
+ */
+double tycho_v_magnitude(
+        const std::optional<double>& bt_mag,
+        const std::optional<double>& vt_mag,
+        uint8_t* sources
+) {
+    if (sources)
+        *sources = (bt_mag ? 1 : 0) | (vt_mag ? 2 : 0);
+
+    if (bt_mag) {
+        const auto bt = bt_mag.value();
+        if (vt_mag) {
+            const auto vt = vt_mag.value();
+            const auto v_mag = vt - 0.090 * (bt - vt);
+            // std::cout << boost::format("Debug: Calculated V_Mag = %1$.3f") % v_mag << std::endl;
+            return v_mag;
+        } else {
+            // std::cout << boost::format("Debug: Using BT_Mag as V_Mag = %1$.3f") % bt << std::endl;
+            return bt;
+        }
+    } else {
+        if (vt_mag) {
+            const auto vt = vt_mag.value();
+            // std::cout << boost::format("Debug: Using VT_Mag as V_Mag = %1$.3f") % vt << std::endl;
+            return vt;
+        } else {
+            throw std::runtime_error("Missing magnitude");
+        }
+    }
+}
+
+}
+
+
+std::optional<double> parse_field(
+        const Record& record,
+        const size_t index,
+        const std::string& field_name
+) {
+    return convert_field(record_field(record, index), field_name);
+}
+
+
+std::optional<double> parse_optional_field(
+        const Record& record,
+        const size_t index
+) noexcept {
+    return convert_optional_field(record_field(record, index));
+}
+
+
+double parse_magnitude(
+        const Record& record,
+        const size_t bt_index,
+        const size_t vt_index,
+        uint8_t* sources
+) {
+    // Parse each magnitude on its own, so a blank BT does not hide a valid VT
+    return tycho_v_magnitude(
+        parse_optional_field(record, bt_index),
+        parse_optional_field(record, vt_index),
+        sources
+    );
+}
+
+
+namespace {
+
+double tycho_magnitude(
+        const Record& record,
+        const std::vector<Column>& columns,
+        uint8_t& sources
+) {
+    return parse_magnitude(record, columns[0].index, columns[1].index, &sources);
+}
+
+
+double direct_magnitude(
+        const Record& record,
+        const std::vector<Column>& columns,
+        uint8_t& sources
+) {
+    const auto mag = parse_field(record, columns[0].index, "magnitude").value();
+    sources = 1;
+    return mag;
+}
+
+
+/**
+ * \brief   Johnson V from Gaia G and BP-RP (Riello et al. 2021); plain G when the colour is missing.
+ */
+double gaia_magnitude(
+        const Record& record,
+        const std::vector<Column>& columns,
+        uint8_t& sources
+) {
+    const auto g = parse_field(record, columns[0].index, "G magnitude").value();
+
+    const auto bp_rp = parse_optional_field(record, columns[1].index);
+    sources = bp_rp ? 3 : 1;
+    if (!bp_rp)
+        return g;
+
+    const auto c = bp_rp.value();
+    return g + 0.02704 - 0.01424 * c + 0.2156 * c * c - 0.01426 * c * c * c;
+}
+
+
+/**
+ * \brief   Converts a schema field to its value type.
+ *
+ * \throw   std::runtime_error if the field is missing or not a valid value
+ */
+template<typename Field, typename Schema>
+typename Field::type parse_schema_field(
+        const Schema& record,
+        const std::string& field_name
+) {
+    static_assert(!Field::nullable, "Nullable fields are read with parse_optional_schema_field()");
+    return convert_field<typename Field::type>(record.template field<Field>(), field_name);
+}
+
+
+/**
+ * \return  nothing if the field is missing, blank or not a valid value
+ */
+template<typename Field, typename Schema>
+std::optional<typename Field::type> parse_optional_schema_field(const Schema& record) noexcept {
+    return convert_optional_field<typename Field::type>(record.template field<Field>());
+}
+
+
+/**
+ * \brief   FixedStarParser for a Tycho-2 layout, see tycho_magnitude().
+ */
+template<typename Ra, typename De, typename Bt, typename Vt>
+Star parse_tycho_star(
+        const std::string_view line,
+        const char delimiter,
+        uint8_t& sources
+) {
+    SchemaRecord<Ra, De, Bt, Vt> record;
+    record.split(line, delimiter);
+    const auto ra = parse_schema_field<Ra>(record, "RA");
+    const auto dec = parse_schema_field<De>(record, "Dec");
+    const auto mag = tycho_v_magnitude(
+        parse_optional_schema_field<Bt>(record),
+        parse_optional_schema_field<Vt>(record),
+        &sources
+    );
+    return Star(ra, dec, mag);
+}
+
+
+/**
+ * \brief   FixedStarParser for a layout with a single magnitude column, see direct_magnitude().
+ */
+template<typename Ra, typename De, typename Mag>
+Star parse_direct_star(
+        const std::string_view line,
+        const char delimiter,
+        uint8_t& sources
+) {
+    SchemaRecord<Ra, De, Mag> record;
+    record.split(line, delimiter);
+    const auto ra = parse_schema_field<Ra>(record, "RA");
+    const auto dec = parse_schema_field<De>(record, "Dec");
+    const auto mag = parse_schema_field<Mag>(record, "magnitude");
+    sources = 1;
+    return Star(ra, dec, mag);
+}
+
+
+const std::vector<CatalogFormat>& builtin_formats() {
+    namespace tycho2 = tycho2_columns;
+    namespace suppl = tycho2_suppl_columns;
+    namespace hip = hipparcos_columns;
+
+    static const std::vector<CatalogFormat> formats = {
+        {
+            "tycho2", '|', false,
+            tycho2::RA::index, tycho2::DE::index,
+            {tycho2::BT::index, tycho2::VT::index}, tycho_magnitude,
+            AstrometryColumns{tycho2::MEAN_RA::index, tycho2::MEAN_DE::index, tycho2::PM_RA::index, tycho2::PM_DE::index, 2000.0},
+            Column(tycho2::TYC::index), Column(tycho2::HIP::index),
+            parse_tycho_star<tycho2::RA, tycho2::DE, tycho2::BT, tycho2::VT>
+        },
+        {
+            "tycho2-suppl", '|', false,
+            suppl::RA::index, suppl::DE::index,
+            {suppl::BT::index, suppl::VT::index}, tycho_magnitude,
+            AstrometryColumns{suppl::RA::index, suppl::DE::index, suppl::PM_RA::index, suppl::PM_DE::index, 1991.25},
+            Column(suppl::TYC::index), Column(suppl::HIP::index),
+            parse_tycho_star<suppl::RA, suppl::DE, suppl::BT, suppl::VT>
+        },
+        {
+            "hipparcos", '|', false,
+            hip::RA::index, hip::DE::index,
+            {hip::VMAG::index}, direct_magnitude,
+            AstrometryColumns{hip::RA::index, hip::DE::index, hip::PM_RA::index, hip::PM_DE::index, 1991.25},
+            std::nullopt, Column(hip::HIP::index),
+            parse_direct_star<hip::RA, hip::DE, hip::VMAG>
+        },
+        {
+            "gaia", ',', true,
+            "ra", "dec",
+            {"phot_g_mean_mag", "bp_rp"}, gaia_magnitude,
+            AstrometryColumns{"ra", "dec", "pmra", "pmdec", 2016.0},
+            std::nullopt, std::nullopt,
+            nullptr
+        },
+        {
+            "csv", ',', true,
+            "ra", "dec",
+            {"mag"}, direct_magnitude,
+            std::nullopt,
+            std::nullopt, std::nullopt,
+            nullptr
+        },
+    };
+    return formats;
+}
+
+
+void resolve_column(
+        const Record& header,
+        Column& column
+) {
+    if (column.name.empty())
+        return;
+
+    for (std::size_t i = 0; i < header.size(); i++) {
+        if (std::string_view(header[i]) == column.name) {
+            column.index = i;
+            return;
+        }
+    }
+    throw std::runtime_error(
+        (
+            boost::format("Column %1% not found in the header") % column.name
+        ).str()
+    );
+}
+
+
+/**
+ * \brief   Packs a "TYC1 TYC2 TYC3" identifier into a single number.
+ */
+std::optional<uint64_t> parse_tyc_id(const char* field) {
+    const char* begin = field;
+    char* end;
+    const auto tyc1 = std::strtoul(begin, &end, 10);
+    if (end == begin)
+        return std::nullopt;
+    begin = end;
+    const auto tyc2 = std::strtoul(begin, &end, 10);
+    if (end == begin)
+        return std::nullopt;
+    begin = end;
+    const auto tyc3 = std::strtoul(begin, &end, 10);
+    if (end == begin)
+        return std::nullopt;
+    return (static_cast<uint64_t>(tyc1) * 100000 + tyc2) * 10 + tyc3;
+}
+
+
+/**
+ * \brief   Extracts the Hipparcos number from a field; only the leading six characters are
+ *          read, which skips the CCDM component in Tycho-2.
+ */
+std::optional<uint32_t> parse_hip_id(const std::string_view field) {
+    char digits[7] = {};
+    field.copy(digits, 6);
+    const auto hip = std::strtoul(digits, nullptr, 10);
+    if (hip == 0)
+        return std::nullopt;
+    return hip;
+}
+
+
+std::optional<uint64_t> parse_tyc_column(
+        const Record& record,
+        const CatalogFormat& format
+) {
+    if (!format.tyc || record.size() <= format.tyc->index)
+        return std::nullopt;
+    return parse_tyc_id(FieldText(record[format.tyc->index]).c_str());
+}
+
+
+std::optional<uint32_t> parse_hip_column(
+        const Record& record,
+        const CatalogFormat& format
+) {
+    if (!format.hip || record.size() <= format.hip->index)
+        return std::nullopt;
+    return parse_hip_id(record[format.hip->index]);
+}
+
+
+/**
+ * \brief   Reads the mean position and proper motion of a record.
+ *
+ * Falls back to the observed position with zero proper motion when the mean
+ * position is blank (Tycho-2 pflag 'X'); a blank proper motion counts as zero.
+ */
+void parse_astrometry(
+        const Record& record,
+        const CatalogFormat& format,
+        double& ra,
+        double& de,
+        double& pm_ra,
+        double& pm_de
+) {
+    const auto& astrometry = format.astrometry.value();
+
+    const auto mean_ra = parse_optional_field(record, astrometry.ra.index);
+    const auto mean_de = parse_optional_field(record, astrometry.de.index);
+
+    if (!mean_ra || !mean_de) {
+        ra = parse_field(record, format.ra.index, "RA").value();
+        de = parse_field(record, format.de.index, "Dec").value();
+        pm_ra = 0;
+        pm_de = 0;
+        return;
+    }
+
+    ra = mean_ra.value();
+    de = mean_de.value();
+
+    const auto motion_ra = parse_optional_field(record, astrometry.pm_ra.index);
+    const auto motion_de = parse_optional_field(record, astrometry.pm_de.index);
+    pm_ra = motion_ra.value_or(0);
+    pm_de = motion_de.value_or(0);
+}
+
+}
+
+
+void split_record(
+        const std::string_view line,
+        const char delimiter,
+        Record& record
+) {
+    DelimiterScanner scanner(line, delimiter);
+    record.start(line.data());
+    for (auto end = scanner.next(); end < line.size(); end = scanner.next())
+        if (line[end] == delimiter)
+            record.end_field(end);
+    record.end_field(line.size());
+}
+
+
+CatalogFormat resolve_format(
+        const CatalogFormat& format,
+        const std::string& header_line
+) {
+    CatalogFormat resolved = format;
+    Record header;
+    split_record(header_line, format.delimiter, header);
+
+    resolve_column(header, resolved.ra);
+    resolve_column(header, resolved.de);
+    for (auto& column : resolved.magnitude_columns)
+        resolve_column(header, column);
+    if (resolved.astrometry) {
+        // Astrometry is optional in extracts; drop it if any of its columns is missing
+        try {
+            resolve_column(header, resolved.astrometry->ra);
+            resolve_column(header, resolved.astrometry->de);
+            resolve_column(header, resolved.astrometry->pm_ra);
+            resolve_column(header, resolved.astrometry->pm_de);
+        }
+        catch (const std::runtime_error&) {
+            resolved.astrometry.reset();
+        }
+    }
+    if (resolved.tyc)
+        resolve_column(header, *resolved.tyc);
+    if (resolved.hip)
+        resolve_column(header, *resolved.hip);
+
+    return resolved;
+}
+
+
+void collect_catalog_ids(
+        const Record& record,
+        const CatalogFormat& format,
+        CatalogIds& ids
+) {
+    if (const auto tyc = parse_tyc_column(record, format))
+        ids.tyc.insert(*tyc);
+    if (const auto hip = parse_hip_column(record, format))
+        ids.hip.insert(*hip);
+}
+
+
+void parse_mean_position_record(
+        const Record& record,
+        const CatalogFormat& format,
+        MeanPositionColumns& columns
+) {
+    uint8_t sources;
+    const auto mag = format.magnitude(record, format.magnitude_columns, sources);
+    double ra, de, pm_ra, pm_de;
+    parse_astrometry(record, format, ra, de, pm_ra, pm_de);
+    columns.push_back(ra, de, pm_ra, pm_de, mag, sources);
+}
+
+
+const CatalogFormat& catalog_format(const std::string& name) {
+    for (const auto& format : builtin_formats())
+        if (format.name == name)
+            return format;
+
+    throw std::runtime_error(
+        (
+            boost::format("Unknown catalog format: %1%") % name
+        ).str()
+    );
+}
+
+
+std::vector<std::string> catalog_format_names() {
+    std::vector<std::string> names;
+    for (const auto& format : builtin_formats())
+        names.push_back(format.name);
+    return names;
+}
+
+
+CatalogReader::CatalogReader(
+            const std::string& path,
+            const CatalogFormat& format
+):
+        CatalogReader(open_catalog_stream(path), format, path)
+{}
+
+
+CatalogReader::CatalogReader(
+            std::unique_ptr<std::istream> input,
+            const CatalogFormat& format,
+            const std::string& name
+):
+        file(std::move(input)),
+        resolved_format(format),
+        rows(0)
+{
+    if (!*file)
+        throw std::runtime_error(
+            (
+                boost::format("Failed to open catalog %1%") % name
+            ).str()
+        );
+
+    if (!resolved_format.header)
+        return;
+
+    if (!std::getline(*file, current_line))
+        throw std::runtime_error(
+            (
+                boost::format("Missing header line in %1%") % name
+            ).str()
+        );
+    if (!current_line.empty() && current_line.back() == '\r')
+        current_line.pop_back();
+    resolved_format = resolve_format(format, current_line);
+}
+
+
+bool CatalogReader::next(Record& record) {
+    if (!next())
+        return false;
+
+    split_record(current_line, resolved_format.delimiter, record);
+    return true;
+}
+
+
+bool CatalogReader::next() {
+    if (!std::getline(*file, current_line)) {
+        if (file->bad())
+            throw std::runtime_error("Failed to read catalog: corrupt or truncated input");
+        return false;
+    }
+
+    if (!current_line.empty() && current_line.back() == '\r')
+        current_line.pop_back();
+    rows++;
+    return true;
+}
+
+
+const std::string& CatalogReader::line() const noexcept {
+    return current_line;
+}
+
+
+std::size_t CatalogReader::row() const noexcept {
+    return rows - 1;
+}
+
+
+const CatalogFormat& CatalogReader::format() const noexcept {
+    return resolved_format;
+}
+
+
+void SkippedRows::report(
+        const std::size_t row,
+        const std::string& error,
+        const std::string& line
+) {
+    skipped++;
+    skipped_rows.set(row);
+    errors[error]++;
+    if (skipped < PRINTED_ROWS) {
+        log_error("Skipping row %1% due to error: %2%", row, error);
+        log_error("Problematic row: %1%", line);
+    } else if (skipped == PRINTED_ROWS) {
+        log_error("Further skipped rows will not be printed...");
+    }
+}
+
+
+void SkippedRows::add_unreported(
+        const std::size_t row,
+        const std::string& error
+) {
+    skipped++;
+    skipped_rows.set(row);
+    errors[error]++;
+}
+
+
+const RowBitmap& SkippedRows::rows() const noexcept {
+    return skipped_rows;
+}
+
+
+std::size_t SkippedRows::count() const noexcept {
+    return skipped;
+}
+
+
+const std::map<std::string, std::size_t>& SkippedRows::reasons() const noexcept {
+    return errors;
+}
+
+
+Star parse_star_record(
+        const Record& record,
+        const CatalogFormat& format,
+        uint8_t* mag_sources
+) {
+    const auto ra = parse_field(record, format.ra.index, "RA");
+    const auto dec = parse_field(record, format.de.index, "Dec");
+    uint8_t sources;
+    const auto mag = format.magnitude(record, format.magnitude_columns, sources);
+    if (mag_sources)
+        *mag_sources = sources;
+
+    return Star(
+        ra.value(),
+        dec.value(),
+        mag
+    );
+}
+
+
+void PredicateCounters::add(const PredicateCounters& other) noexcept {
+    rows += other.rows;
+    rejected_dec += other.rejected_dec;
+    rejected_ra += other.rejected_ra;
+    rejected_magnitude += other.rejected_magnitude;
+    fields_parsed += other.fields_parsed;
+    fields_total += other.fields_total;
+}
+
+
+void PredicateCounters::report() const {
+    const double parsed_share = fields_total != 0 ? 100.0 * fields_parsed / fields_total : 100.0;
+    log_info("Rows rejected while parsing: %1% by Dec, %2% by RA, %3% by magnitude, of %4%", rejected_dec, rejected_ra, rejected_magnitude, rows);
+    log_info("Fields parsed: %1% of %2% (%3$.1f%%)", fields_parsed, fields_total, parsed_share);
+}
+
+
+StarPredicateParser::StarPredicateParser(
+            const CatalogFormat& format,
+            const StarFilter& filter
+):
+        format(format),
+        filter(filter)
+{
+    // Shares of the sky inside each range, for stars spread evenly over it
+    const auto sin_dec = [] (const double dec) {
+        return std::sin(std::clamp(dec, -90.0, 90.0) * M_PI / 180);
+    };
+    const double dec_share = std::max(0.0, sin_dec(filter.max_dec) - sin_dec(filter.min_dec)) / 2;
+    const double ra_share = std::clamp((filter.max_ra - filter.min_ra) / 360, 0.0, 1.0);
+    ra_first = ra_share <= dec_share;
+}
+
+
+bool StarPredicateParser::accepts_ra(
+        const Record& record,
+        double& ra
+) {
+    ra = parse_field(record, format.ra.index, "RA").value();
+    stats.fields_parsed++;
+    if (ra >= filter.min_ra && ra <= filter.max_ra)
+        return true;
+    stats.rejected_ra++;
+    return false;
+}
+
+
+bool StarPredicateParser::accepts_dec(
+        const Record& record,
+        double& dec
+) {
+    dec = parse_field(record, format.de.index, "Dec").value();
+    stats.fields_parsed++;
+    if (dec >= filter.min_dec && dec <= filter.max_dec)
+        return true;
+    stats.rejected_dec++;
+    return false;
+}
+
+
+std::optional<Star> StarPredicateParser::parse(
+        const Record& record,
+        uint8_t* mag_sources
+) {
+    stats.rows++;
+    stats.fields_total += 2 + format.magnitude_columns.size();
+
+    double ra;
+    double dec;
+    if (ra_first) {
+        if (!accepts_ra(record, ra) || !accepts_dec(record, dec))
+            return std::nullopt;
+    } else {
+        if (!accepts_dec(record, dec) || !accepts_ra(record, ra))
+            return std::nullopt;
+    }
+
+    uint8_t sources;
+    const auto mag = format.magnitude(record, format.magnitude_columns, sources);
+    stats.fields_parsed += format.magnitude_columns.size();
+    if (!(mag <= filter.max_magnitude)) {
+        stats.rejected_magnitude++;
+        return std::nullopt;
+    }
+    if (mag_sources)
+        *mag_sources = sources;
+
+    return Star(ra, dec, mag);
+}
+
+
+const PredicateCounters& StarPredicateParser::counters() const noexcept {
+    return stats;
+}
+
+
+namespace {
+
+std::vector<Star> read_stars(
+        CatalogReader& reader,
+        const StarFilter& filter,
+        CatalogIds* ids
+) {
+    const TraceScope trace("read_stars");
+    std::vector<Star> stars;
+    SkippedRows skipped_rows;
+    PredicateCounters predicates;
+    {
+        StarPredicateParser parser(reader.format(), filter);
+        ParseArena arena;
+        Record record(&arena);
+        while (reader.next(record)) {
+            if (ids)
+                collect_catalog_ids(record, reader.format(), *ids);
+            try {
+                const auto star = parser.parse(record);
+                if (star) {
+                    const auto i = reader.row();
+                    if (log_progress_row(i))
+                        log_progress("Star %1%: RA=%2%, Dec=%3%, Mag=%4%", i, star->ra_deg, star->de_deg, star->mag);
+
+                    stars.push_back(*star);
+                }
+            }
+            catch (const std::runtime_error& e) {
+                skipped_rows.report(reader.row(), e.what(), reader.line());
+            }
+        }
+        predicates = parser.counters();
+    }
+
+    log_info("Total stars read and filtered: %1%", stars.size());
+    log_info("Total rows skipped: %1%", skipped_rows.count());
+    predicates.report();
+
+    return stars;
+}
+
+}
+
+
+std::vector<Star> read_stars(
+        const std::string& path,
+        const CatalogFormat& format,
+        const StarFilter& filter,
+        CatalogIds* ids
+) {
+    TraceScope open_trace("open");
+    CatalogReader reader(path, format);
+    open_trace.stop();
+    return read_stars(reader, filter, ids);
+}
+
+
+std::vector<Star> read_stars(
+        std::unique_ptr<std::istream> input,
+        const CatalogFormat& format,
+        const StarFilter& filter,
+        CatalogIds* ids
+) {
+    TraceScope open_trace("open");
+    CatalogReader reader(std::move(input), format);
+    open_trace.stop();
+    return read_stars(reader, filter, ids);
+}
+
+
+std::size_t read_star_blocks(
+        const std::string& path,
+        const CatalogFormat& format,
+        const std::size_t block_rows,
+        const std::function<void(const StarColumns&)>& consume,
+        CatalogIds* ids
+) {
+    SkippedRows skipped;
+    StarColumns block;
+    block.reserve(block_rows);
+
+    CatalogReader reader(path, format);
+    const auto fixed_parser = ids ? nullptr : reader.format().fixed_star_parser;
+    ParseArena arena;
+    Record record(&arena);
+    while (fixed_parser ? reader.next() : reader.next(record)) {
+        if (ids)
+            collect_catalog_ids(record, reader.format(), *ids);
+        try {
+            uint8_t sources;
+            const auto star = fixed_parser
+                ? fixed_parser(reader.line(), reader.format().delimiter, sources)
+                : parse_star_record(record, reader.format(), &sources);
+            block.push_back(star.ra_deg, star.de_deg, star.mag, sources);
+        }
+        catch (const std::runtime_error& e) {
+            skipped.report(reader.row(), e.what(), reader.line());
+        }
+
+        if (block.size() == block_rows) {
+            consume(block);
+            block.clear();
+        }
+    }
+    if (block.size() != 0)
+        consume(block);
+
+    return skipped.count();
+}
+
+
+std::size_t read_mean_position_blocks(
+        const std::string& path,
+        const CatalogFormat& format,
+        const std::size_t block_rows,
+        const std::function<void(const MeanPositionColumns&)>& consume,
+        CatalogIds* ids
+) {
+    SkippedRows skipped;
+    MeanPositionColumns block;
+    block.reserve(block_rows);
+
+    CatalogReader reader(path, format);
+    if (!reader.format().astrometry)
+        throw std::runtime_error(
+            (
+                boost::format("Catalog %1% has no proper motions for epoch propagation") % path
+            ).str()
+        );
+
+    ParseArena arena;
+    Record record(&arena);
+    while (reader.next(record)) {
+        if (ids)
+            collect_catalog_ids(record, reader.format(), *ids);
+        try {
+            parse_mean_position_record(record, reader.format(), block);
+        }
+        catch (const std::runtime_error& e) {
+            skipped.report(reader.row(), e.what(), reader.line());
+        }
+
+        if (block.size() == block_rows) {
+            consume(block);
+            block.clear();
+        }
+    }
+    if (block.size() != 0)
+        consume(block);
+
+    return skipped.count();
+}
+
+
+MeanPositionColumns read_mean_positions(
+        const std::string& path,
+        const CatalogFormat& format,
+        std::size_t& skipped_rows,
+        CatalogIds* ids
+) {
+    MeanPositionColumns columns;
+    skipped_rows = read_mean_position_blocks(
+        path,
+        format,
+        STAR_BLOCK_ROWS,
+        [&columns] (const MeanPositionColumns& block) {
+            columns.append(block);
+        },
+        ids
+    );
+    return columns;
+}
+
+
+std::vector<CatalogEntry> read_entries(
+        const std::string& path,
+        const CatalogFormat& format,
+        std::size_t& skipped_rows
+) {
+    std::vector<CatalogEntry> entries;
+    SkippedRows skipped;
+
+    CatalogReader reader(path, format);
+    const auto& resolved = reader.format();
+    ParseArena arena;
+    Record record(&arena);
+    while (reader.next(record)) {
+        try {
+            uint8_t sources;
+            const auto star = parse_star_record(record, resolved, &sources);
+            CatalogEntry entry{
+                star.ra_deg, star.de_deg, star.mag, sources,
+                star.ra_deg, star.de_deg, 0, 0,
+                parse_tyc_column(record, resolved),
+                parse_hip_column(record, resolved)
+            };
+            if (resolved.astrometry)
+                parse_astrometry(record, resolved, entry.mean_ra_deg, entry.mean_de_deg, entry.pm_ra_mas, entry.pm_de_mas);
+            entries.push_back(entry);
+        }
+        catch (const std::runtime_error& e) {
+            skipped.report(reader.row(), e.what(), reader.line());
+        }
+    }
+
+    skipped_rows = skipped.count();
+    return entries;
+}
@@ -0,0 +1,631 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "delimiter_scanner.hpp"
+#include "record_schema.hpp"
+#include "row_bitmap.hpp"
+#include "star.hpp"
+#include "star_columns.hpp"
+
+
+/**
+ * \brief   Fields of one catalog row, as an index of field offsets into the row text.
+ *
+ * Fields are views of the text the record was split from, which must stay
+ * alive and unchanged while they are used.
+ */
+class Record {
+    public:
+        explicit Record(std::pmr::memory_resource* resource = std::pmr::get_default_resource()):
+                field_ends(resource) {}
+
+        std::size_t size() const noexcept {
+            return field_ends.size();
+        }
+
+        std::string_view operator[](const std::size_t index) const noexcept {
+            const std::size_t begin = index != 0 ? field_ends[index - 1] + 1 : 0;
+            return std::string_view(row + begin, field_ends[index] - begin);
+        }
+
+        /**
+         * \brief   Starts a new row, dropping the fields of the previous one.
+         */
+        void start(const char* text) noexcept {
+            row = text;
+            field_ends.clear();
+        }
+
+        /**
+         * \brief   Ends the current field at an offset from the start of the row; the next one starts after it.
+         */
+        void end_field(const std::size_t offset) {
+            field_ends.push_back(static_cast<uint32_t>(offset));
+        }
+
+    private:
+        const char* row = nullptr;
+        std::pmr::vector<uint32_t> field_ends;
+};
+
+
+/**
+ * \brief   Arena for the record of one parsing thread.
+ *
+ * A record keeps its field index from row to row, so a record built on an
+ * arena sizes its storage on the first row and then parses without touching
+ * the heap. Everything is freed at once with the arena.
+ */
+class ParseArena : public std::pmr::monotonic_buffer_resource {
+    public:
+        ParseArena():
+                std::pmr::monotonic_buffer_resource(INITIAL_BYTES) {}
+
+    private:
+        /// Enough for the field index of the widest supported row (hip_main.dat, 78 fields) as it grows
+        static constexpr std::size_t INITIAL_BYTES = 4 << 10;
+};
+
+
+/// Columns of the Tycho-2 main catalog (catalog.dat)
+namespace tycho2_columns {
+    using TYC = SchemaField<0, uint64_t>;
+    using MEAN_RA = SchemaField<2, double, true>;
+    using MEAN_DE = SchemaField<3, double, true>;
+    using PM_RA = SchemaField<4, double, true>;
+    using PM_DE = SchemaField<5, double, true>;
+    using BT = SchemaField<17, double, true>;
+    using VT = SchemaField<19, double, true>;
+    using HIP = SchemaField<23, uint32_t, true>;
+    using RA = SchemaField<24, double>;
+    using DE = SchemaField<25, double>;
+}
+
+
+/// Columns of the Tycho-2 supplements (suppl_1.dat, suppl_2.dat)
+namespace tycho2_suppl_columns {
+    using TYC = SchemaField<0, uint64_t>;
+    using RA = SchemaField<2, double>;
+    using DE = SchemaField<3, double>;
+    using PM_RA = SchemaField<4, double, true>;
+    using PM_DE = SchemaField<5, double, true>;
+    using BT = SchemaField<11, double, true>;
+    using VT = SchemaField<13, double, true>;
+    using HIP = SchemaField<17, uint32_t, true>;
+}
+
+
+/// Columns of the Hipparcos main catalog (hip_main.dat)
+namespace hipparcos_columns {
+    using HIP = SchemaField<1, uint32_t>;
+    using VMAG = SchemaField<5, double>;
+    using RA = SchemaField<8, double>;
+    using DE = SchemaField<9, double>;
+    using PM_RA = SchemaField<12, double, true>;
+    using PM_DE = SchemaField<13, double, true>;
+}
+
+
+/**
+ * \throw   std::runtime_error if the field is missing or not a number
+ */
+std::optional<double> parse_field(
+        const Record& record,
+        const size_t index,
+        const std::string& field_name
+);
+
+
+/**
+ * \brief   Parses a field that may be blank.
+ *
+ * Unlike parse_field(), a missing or malformed field is not an error, so
+ * rows with blank optional columns do not raise and format exceptions.
+ *
+ * \return  nothing if the field is missing or not a number
+ */
+std::optional<double> parse_optional_field(
+        const Record& record,
+        const size_t index
+) noexcept;
+
+
+/**
+ * \brief   Derives V from Tycho BT/VT magnitudes, falling back to whichever one is present.
+ *
+ * \param   sources     if set, receives bit 0 if BT was present and bit 1 if VT was
+ */
+double parse_magnitude(
+        const Record& record,
+        const size_t bt_index = tycho2_columns::BT::index,
+        const size_t vt_index = tycho2_columns::VT::index,
+        uint8_t* sources = nullptr
+);
+
+
+/**
+ * \brief   Reference to a catalog column, by position or by header name.
+ */
+struct Column {
+    std::size_t index;
+    std::string name;
+
+    Column(const int index):
+            index(index)
+    {}
+
+    Column(const char* name):
+            index(0),
+            name(name)
+    {}
+};
+
+
+/**
+ * \brief   Derives the visual magnitude of a record from the given columns.
+ *
+ * Bit i of sources is set if column i held a value.
+ *
+ * \throw   std::runtime_error if the magnitude can not be derived
+ */
+using MagnitudeFunction = double (*)(
+        const Record& record,
+        const std::vector<Column>& columns,
+        uint8_t& sources
+);
+
+
+/**
+ * \brief   Parses position and magnitude of a row without splitting all of it, see SchemaRecord.
+ *
+ * Generated for formats with a fixed column layout; equivalent to
+ * split_record() followed by parse_star_record().
+ *
+ * \param   line    row text without the line end
+ * \throw   std::runtime_error like parse_star_record()
+ */
+using FixedStarParser = Star (*)(
+        const std::string_view line,
+        const char delimiter,
+        uint8_t& sources
+);
+
+
+/**
+ * \brief   Mean positions and proper motions of a catalog, used for epoch propagation.
+ */
+struct AstrometryColumns {
+    Column ra;
+    Column de;
+    Column pm_ra;
+    Column pm_de;
+    /// Epoch of the mean positions, Julian years
+    double epoch;
+};
+
+
+/**
+ * \brief   Layout of a catalog file: delimiter, column mapping and magnitude derivation.
+ *
+ * Formats with a header line refer to columns by name; the names are
+ * resolved when a CatalogReader opens the file.
+ */
+struct CatalogFormat {
+    std::string name;
+    char delimiter;
+    bool header;
+    Column ra;
+    Column de;
+    std::vector<Column> magnitude_columns;
+    MagnitudeFunction magnitude;
+    std::optional<AstrometryColumns> astrometry;
+    std::optional<Column> tyc;
+    std::optional<Column> hip;
+    /// Fast path for reading stars, if the column layout is fixed
+    FixedStarParser fixed_star_parser;
+};
+
+
+/**
+ * \brief   Looks up a built-in catalog format by name.
+ *
+ * \throw   std::runtime_error for an unknown name
+ */
+const CatalogFormat& catalog_format(const std::string& name);
+
+
+/**
+ * \brief   Names of the built-in catalog formats.
+ */
+std::vector<std::string> catalog_format_names();
+
+
+/**
+ * \brief   Splits a row into fields at the delimiter.
+ *
+ * The record indexes the line in place, see DelimiterScanner.
+ */
+void split_record(
+        const std::string_view line,
+        const char delimiter,
+        Record& record
+);
+
+
+/**
+ * \brief   Splits every row of a block of text in one pass of a DelimiterScanner.
+ *
+ * Line ends ("\n" or "\r\n") are not part of the rows; a final row without a
+ * line end is included.
+ *
+ * \param   consume     called as consume(record, line) for every row, in order
+ */
+template<typename Consume>
+void split_records(
+        const std::string_view text,
+        const char delimiter,
+        Record& record,
+        Consume&& consume
+) {
+    DelimiterScanner scanner(text, delimiter);
+    std::size_t line_begin = 0;
+    record.start(text.data());
+    while (line_begin < text.size()) {
+        const auto end = scanner.next();
+        if (end < text.size() && text[end] == delimiter) {
+            record.end_field(end - line_begin);
+            continue;
+        }
+
+        auto line_end = end;
+        if (line_end > line_begin && text[line_end - 1] == '\r')
+            line_end--;
+        record.end_field(line_end - line_begin);
+        consume(
+            static_cast<const Record&>(record),
+            text.substr(line_begin, line_end - line_begin)
+        );
+        line_begin = end + 1;
+        record.start(text.data() + line_begin);
+    }
+}
+
+
+/**
+ * \brief   Resolves the named columns of a format against a header line.
+ *
+ * \throw   std::runtime_error if a required column is missing from the header
+ */
+CatalogFormat resolve_format(
+        const CatalogFormat& format,
+        const std::string& header_line
+);
+
+
+/**
+ * \brief   Streams records of a catalog file, one row at a time.
+ *
+ * gzip and zstd compressed files are decompressed on the fly.
+ *
+ * Only the current row is held in memory, so arbitrarily large catalogs can
+ * be scanned.
+ */
+class CatalogReader {
+    public:
+        /**
+         * \throw   std::runtime_error if the file can not be opened or a named column is missing from the header
+         */
+        CatalogReader(
+                const std::string& path,
+                const CatalogFormat& format
+        );
+
+        /**
+         * \brief   Reads rows from a stream, e.g. a catalog held in memory.
+         *
+         * \param   name    names the input in error messages
+         * \throw   std::runtime_error if the stream is not readable or a named column is missing from the header
+         */
+        CatalogReader(
+                std::unique_ptr<std::istream> input,
+                const CatalogFormat& format,
+                const std::string& name = "stream"
+        );
+
+        /**
+         * \brief   Splits the next row into fields.
+         *
+         * \return  false at the end of the file
+         */
+        bool next(Record& record);
+
+        /**
+         * \brief   Reads the next row without splitting it, see line().
+         *
+         * \return  false at the end of the file
+         */
+        bool next();
+
+        /// Text of the current row
+        const std::string& line() const noexcept;
+
+        /// Index of the current row, counting from zero after the header
+        std::size_t row() const noexcept;
+
+        /// Format with all columns resolved to positions
+        const CatalogFormat& format() const noexcept;
+
+    private:
+        std::unique_ptr<std::istream> file;
+        CatalogFormat resolved_format;
+        std::string current_line;
+        std::size_t rows;
+};
+
+
+/**
+ * \brief   Counts skipped rows and prints the first few of them.
+ *
+ * Also remembers which rows were skipped, and counts them by error.
+ */
+class SkippedRows {
+    public:
+        void report(
+                const std::size_t row,
+                const std::string& error,
+                const std::string& line
+        );
+
+        /**
+         * \brief   Counts a skipped row without printing it.
+         */
+        void add_unreported(
+                const std::size_t row,
+                const std::string& error
+        );
+
+        std::size_t count() const noexcept;
+
+        /// Rows reported so far
+        const RowBitmap& rows() const noexcept;
+
+        /// Skipped rows by error message
+        const std::map<std::string, std::size_t>& reasons() const noexcept;
+
+        /// Number of rows that report() prints (plus the final notice)
+        static constexpr std::size_t PRINTED_ROWS = 11;
+
+    private:
+        std::size_t skipped = 0;
+        RowBitmap skipped_rows;
+        std::map<std::string, std::size_t> errors;
+};
+
+
+/**
+ * \param   mag_sources     if set, receives the magnitude columns present, see MagnitudeFunction
+ */
+Star parse_star_record(
+        const Record& record,
+        const CatalogFormat& format,
+        uint8_t* mag_sources = nullptr
+);
+
+
+/**
+ * \brief   Work a StarPredicateParser did and avoided.
+ */
+struct PredicateCounters {
+    /// Rows evaluated
+    std::size_t rows = 0;
+    /// Rows rejected by each predicate
+    std::size_t rejected_dec = 0;
+    std::size_t rejected_ra = 0;
+    std::size_t rejected_magnitude = 0;
+    /// Numeric fields converted, and those a full parse would have converted
+    std::size_t fields_parsed = 0;
+    std::size_t fields_total = 0;
+
+    void add(const PredicateCounters& other) noexcept;
+
+    /**
+     * \brief   Prints the rejections of each predicate and the share of fields parsed.
+     */
+    void report() const;
+};
+
+
+/**
+ * \brief   Parses the fields of a record lazily, one filter predicate at a time.
+ *
+ * Each predicate parses only the fields it needs and the row is dropped as
+ * soon as one fails, so rows outside the window cost a single conversion.
+ * The narrower of the Dec and RA ranges (by share of the sky) is tested
+ * first, RA on a tie as in parse_star_record(); the magnitude, which takes up
+ * to two fields and a formula, last.
+ *
+ * Errors in fields that are never reached go unnoticed, so rows outside the
+ * window are not counted as skipped.
+ */
+class StarPredicateParser {
+    public:
+        /**
+         * \param   format  with all columns resolved to positions
+         */
+        StarPredicateParser(
+                const CatalogFormat& format,
+                const StarFilter& filter
+        );
+
+        /**
+         * \param   mag_sources     if set, receives the magnitude columns present for accepted stars
+         * \return  nothing if the filter rejects the star
+         * \throw   std::runtime_error if a field needed for the decision is missing or malformed
+         */
+        std::optional<Star> parse(
+                const Record& record,
+                uint8_t* mag_sources = nullptr
+        );
+
+        const PredicateCounters& counters() const noexcept;
+
+    private:
+        bool accepts_ra(const Record& record, double& ra);
+        bool accepts_dec(const Record& record, double& dec);
+
+        const CatalogFormat& format;
+        const StarFilter filter;
+        bool ra_first;
+        PredicateCounters stats;
+};
+
+
+/**
+ * \brief   Identifiers of main-catalog stars, used to drop their duplicates from the supplements.
+ */
+struct CatalogIds {
+    std::unordered_set<uint64_t> tyc;
+    std::unordered_set<uint32_t> hip;
+};
+
+
+/**
+ * \brief   Remembers the TYC and HIP identifiers of a record.
+ */
+void collect_catalog_ids(
+        const Record& record,
+        const CatalogFormat& format,
+        CatalogIds& ids
+);
+
+
+/**
+ * \brief   Parses the magnitude and mean position of a record and appends them to the columns.
+ *
+ * \see     read_mean_positions()
+ */
+void parse_mean_position_record(
+        const Record& record,
+        const CatalogFormat& format,
+        MeanPositionColumns& columns
+);
+
+
+/**
+ * \brief   One fully parsed catalog row.
+ */
+struct CatalogEntry {
+    double ra_deg;
+    double de_deg;
+    double mag;
+    uint8_t mag_sources;
+    /// Mean position and proper motion; zero motion at the observed position when the format has no astrometry
+    double mean_ra_deg;
+    double mean_de_deg;
+    double pm_ra_mas;
+    double pm_de_mas;
+    std::optional<uint64_t> tyc;
+    std::optional<uint32_t> hip;
+};
+
+
+/**
+ * \brief   Reads and filters the stars of a catalog file.
+ *
+ * The filter is evaluated while parsing, see StarPredicateParser.
+ *
+ * \param   ids     if set, receives the TYC/HIP identifiers of every row
+ */
+std::vector<Star> read_stars(
+        const std::string& path,
+        const CatalogFormat& format,
+        const StarFilter& filter,
+        CatalogIds* ids = nullptr
+);
+
+
+/**
+ * \brief   Reads and filters the stars of a catalog stream, see CatalogReader.
+ */
+std::vector<Star> read_stars(
+        std::unique_ptr<std::istream> input,
+        const CatalogFormat& format,
+        const StarFilter& filter,
+        CatalogIds* ids = nullptr
+);
+
+
+/**
+ * \brief   Reads mean positions and proper motions of all stars in the catalog.
+ *
+ * Stars without a mean position keep their observed position and get zero
+ * proper motion.
+ *
+ * \throw   std::runtime_error if the format has no astrometry columns
+ */
+MeanPositionColumns read_mean_positions(
+        const std::string& path,
+        const CatalogFormat& format,
+        std::size_t& skipped_rows,
+        CatalogIds* ids = nullptr
+);
+
+
+/// Default number of stars per block for the block readers.
+constexpr std::size_t STAR_BLOCK_ROWS = 65536;
+
+
+/**
+ * \brief   Streams all stars of a catalog in column blocks, without filtering.
+ *
+ * Rows of formats with a fixed_star_parser are parsed with it unless ids
+ * are collected.
+ *
+ * \param   consume     called for every block; the block is reused afterwards
+ * \param   ids         if set, receives the TYC/HIP identifiers of every row
+ * \return  number of skipped rows
+ */
+std::size_t read_star_blocks(
+        const std::string& path,
+        const CatalogFormat& format,
+        const std::size_t block_rows,
+        const std::function<void(const StarColumns&)>& consume,
+        CatalogIds* ids = nullptr
+);
+
+
+/**
+ * \brief   Streams mean positions and proper motions of a catalog in column blocks.
+ *
+ * \return  number of skipped rows
+ * \throw   std::runtime_error if the format has no astrometry columns
+ * \see     read_mean_positions()
+ */
+std::size_t read_mean_position_blocks(
+        const std::string& path,
+        const CatalogFormat& format,
+        const std::size_t block_rows,
+        const std::function<void(const MeanPositionColumns&)>& consume,
+        CatalogIds* ids = nullptr
+);
+
+
+/**
+ * \brief   Reads every row of a (small) catalog file in full.
+ */
+std::vector<CatalogEntry> read_entries(
+        const std::string& path,
+        const CatalogFormat& format,
+        std::size_t& skipped_rows
+);
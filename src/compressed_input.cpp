@@ -0,0 +1,421 @@
+#include "compressed_input.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <boost/format.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include "bounded_queue.hpp"
+
+
+namespace io = boost::iostreams;
+
+
+namespace {
+
+constexpr unsigned char GZIP_MAGIC[] = {0x1f, 0x8b};
+constexpr std::uint32_t ZSTD_MAGIC = 0xFD2FB528;
+constexpr std::uint32_t ZSTD_SKIPPABLE_MAGIC = 0x184D2A50;
+constexpr std::uint32_t ZSTD_SKIPPABLE_MASK = 0xFFFFFFF0;
+
+/// Decompressed bytes handed to the consumer at a time
+constexpr std::size_t OUTPUT_BYTES = 1 << 20;
+
+
+std::runtime_error corrupt(const std::string& path) {
+    return std::runtime_error(
+        (
+            boost::format("Corrupt or truncated compressed catalog %1%") % path
+        ).str()
+    );
+}
+
+
+std::uint32_t read_le(
+        const unsigned char* data,
+        const int bytes
+) noexcept {
+    std::uint32_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+
+/**
+ * \brief   Output device that passes decompressed bytes on to the consumer.
+ */
+class ConsumerSink {
+    public:
+        typedef char char_type;
+        typedef io::sink_tag category;
+
+        explicit ConsumerSink(const std::function<void(const char*, std::size_t)>& consume):
+                consume(&consume) {}
+
+        std::streamsize write(
+                const char* data,
+                const std::streamsize size
+        ) {
+            (*consume)(data, static_cast<std::size_t>(size));
+            return size;
+        }
+
+    private:
+        const std::function<void(const char*, std::size_t)>* consume;
+};
+
+
+/**
+ * \brief   Inflates the file on this thread while another thread reads it.
+ */
+void inflate_gzip(
+        const std::string& path,
+        const AsyncReadOptions& read_options,
+        const std::function<void(const char*, std::size_t)>& consume
+) {
+    BoundedQueue<std::string> blocks(read_options.depth);
+    std::exception_ptr read_error;
+    std::thread reader(
+        [&] {
+            try {
+                read_file_blocks(
+                    path,
+                    0,
+                    read_options,
+                    [&blocks] (const char* data, const std::size_t size) {
+                        blocks.push(std::string(data, size));
+                    }
+                );
+            }
+            catch (...) {
+                read_error = std::current_exception();
+            }
+            blocks.close();
+        }
+    );
+
+    std::exception_ptr inflate_error;
+    std::string block;
+    try {
+        io::filtering_ostream out;
+        out.push(io::gzip_decompressor());
+        out.push(ConsumerSink(consume), OUTPUT_BYTES);
+        while (blocks.pop(block) && out)
+            out.write(block.data(), block.size());
+        if (!out)
+            throw corrupt(path);
+        out.reset();
+    }
+    catch (const io::gzip_error&) {
+        inflate_error = std::make_exception_ptr(corrupt(path));
+    }
+    catch (...) {
+        inflate_error = std::current_exception();
+    }
+    // Keep draining, so that the reader does not block on a full queue
+    while (blocks.pop(block)) {}
+
+    reader.join();
+    if (read_error)
+        std::rethrow_exception(read_error);
+    if (inflate_error)
+        std::rethrow_exception(inflate_error);
+}
+
+
+/**
+ * \brief   Finds the frames of a zstd file from their headers, without decompressing them.
+ *
+ * \return  offset and size of every data frame; skippable frames are left out
+ */
+std::vector<std::pair<std::size_t, std::size_t>> zstd_frames(
+        const std::string& path,
+        const unsigned char* data,
+        const std::size_t size
+) {
+    std::vector<std::pair<std::size_t, std::size_t>> frames;
+    std::size_t pos = 0;
+    const auto need = [&] (const std::size_t at, const std::size_t bytes) {
+        if (at + bytes > size)
+            throw corrupt(path);
+    };
+
+    while (pos < size) {
+        need(pos, 4);
+        const auto magic = read_le(data + pos, 4);
+        if ((magic & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC) {
+            need(pos, 8);
+            pos += 8 + read_le(data + pos + 4, 4);
+            continue;
+        }
+        if (magic != ZSTD_MAGIC)
+            throw corrupt(path);
+
+        // Frame header: descriptor, window, dictionary ID and content size
+        const auto start = pos;
+        pos += 4;
+        need(pos, 1);
+        const auto descriptor = data[pos++];
+        const auto content_size_flag = descriptor >> 6;
+        const bool single_segment = (descriptor >> 5) & 1;
+        const bool checksum = (descriptor >> 2) & 1;
+        constexpr std::size_t DICTIONARY_ID_BYTES[] = {0, 1, 2, 4};
+        pos += (single_segment ? 0 : 1) + DICTIONARY_ID_BYTES[descriptor & 3];
+        pos += content_size_flag == 0 ? (single_segment ? 1 : 0) : (std::size_t(1) << content_size_flag);
+
+        // Blocks: 3-byte header with last flag, type and size; RLE blocks store one byte
+        for (bool last = false; !last; ) {
+            need(pos, 3);
+            const auto header = read_le(data + pos, 3);
+            pos += 3;
+            last = header & 1;
+            const auto type = (header >> 1) & 3;
+            if (type == 3)
+                throw corrupt(path);
+            pos += type == 1 ? 1 : (header >> 3);
+        }
+        if (checksum)
+            pos += 4;
+        need(pos, 0);
+        frames.emplace_back(start, pos - start);
+    }
+    return frames;
+}
+
+
+void decompress_zstd_frame(
+        const char* data,
+        const std::size_t size,
+        std::string& output
+) {
+    output.clear();
+    io::filtering_istream in;
+    in.push(io::zstd_decompressor());
+    in.push(io::array_source(data, size));
+    io::copy(in, io::back_inserter(output));
+    if (in.bad())
+        throw std::ios_base::failure("zstd frame");
+}
+
+
+/**
+ * \brief   Decompresses the frames on worker threads and delivers them in order.
+ *
+ * Workers run at most two frames per thread ahead of the consumer, which
+ * bounds the memory held by decompressed frames.
+ */
+void decompress_zstd_frames(
+        const std::string& path,
+        const char* data,
+        const std::vector<std::pair<std::size_t, std::size_t>>& frames,
+        const std::size_t threads,
+        const std::function<void(const char*, std::size_t)>& consume
+) {
+    struct Output {
+        std::string text;
+        bool done = false;
+    };
+    std::vector<Output> outputs(2 * threads);
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::size_t next_start = 0;
+    std::size_t delivered = 0;
+    bool abort = false;
+    std::exception_ptr error;
+
+    const auto work = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            changed.wait(lock, [&] { return abort || next_start >= frames.size() || next_start < delivered + outputs.size(); });
+            if (abort || next_start >= frames.size())
+                return;
+            const auto frame = next_start++;
+            auto& output = outputs[frame % outputs.size()];
+            lock.unlock();
+
+            std::exception_ptr failed;
+            try {
+                decompress_zstd_frame(data + frames[frame].first, frames[frame].second, output.text);
+            }
+            catch (...) {
+                failed = std::make_exception_ptr(corrupt(path));
+            }
+
+            lock.lock();
+            if (failed && !error)
+                error = failed;
+            output.done = true;
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < threads; i++)
+        workers.emplace_back(work);
+
+    std::exception_ptr consume_error;
+    try {
+        while (delivered < frames.size()) {
+            auto& output = outputs[delivered % outputs.size()];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return output.done || error; });
+                if (error)
+                    std::rethrow_exception(error);
+            }
+
+            for (std::size_t pos = 0; pos < output.text.size(); pos += OUTPUT_BYTES)
+                consume(output.text.data() + pos, std::min(OUTPUT_BYTES, output.text.size() - pos));
+
+            std::lock_guard<std::mutex> lock(mutex);
+            output.done = false;
+            delivered++;
+            changed.notify_all();
+        }
+    }
+    catch (...) {
+        consume_error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        abort = true;
+        changed.notify_all();
+    }
+    for (auto& worker : workers)
+        worker.join();
+    if (consume_error)
+        std::rethrow_exception(consume_error);
+}
+
+
+void decompress_zstd(
+        const std::string& path,
+        const std::size_t threads,
+        const std::function<void(const char*, std::size_t)>& consume
+) {
+    io::mapped_file_source file;
+    try {
+        file.open(path);
+    }
+    catch (const std::exception&) {
+        throw std::runtime_error(
+            (
+                boost::format("Failed to open catalog %1%") % path
+            ).str()
+        );
+    }
+
+    const auto frames = zstd_frames(path, reinterpret_cast<const unsigned char*>(file.data()), file.size());
+    if (frames.size() > 1 && threads > 1) {
+        decompress_zstd_frames(path, file.data(), frames, threads, consume);
+        return;
+    }
+
+    // A single frame can only be decompressed as a stream
+    try {
+        io::filtering_ostream out;
+        out.push(io::zstd_decompressor());
+        out.push(ConsumerSink(consume), OUTPUT_BYTES);
+        for (const auto& [offset, size] : frames)
+            out.write(file.data() + offset, size);
+        if (!out)
+            throw corrupt(path);
+        out.reset();
+    }
+    catch (const io::zstd_error&) {
+        throw corrupt(path);
+    }
+}
+
+}
+
+
+Compression detect_compression(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error(
+            (
+                boost::format("Failed to open catalog %1%") % path
+            ).str()
+        );
+
+    unsigned char magic[4] = {};
+    file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+    if (file.gcount() >= 2 && magic[0] == GZIP_MAGIC[0] && magic[1] == GZIP_MAGIC[1])
+        return Compression::gzip;
+    if (file.gcount() == 4) {
+        const auto value = read_le(magic, 4);
+        if (value == ZSTD_MAGIC || (value & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC)
+            return Compression::zstd;
+    }
+    return Compression::none;
+}
+
+
+const char* compression_name(const Compression compression) noexcept {
+    switch (compression) {
+        case Compression::gzip:
+            return "gzip";
+        case Compression::zstd:
+            return "zstd";
+        default:
+            return "none";
+    }
+}
+
+
+std::unique_ptr<std::istream> open_catalog_stream(const std::string& path) {
+    const auto compression = detect_compression(path);
+    if (compression == Compression::none)
+        return std::make_unique<std::ifstream>(path);
+
+    auto stream = std::make_unique<io::filtering_istream>();
+    if (compression == Compression::gzip) {
+        stream->push(io::gzip_decompressor());
+    } else {
+        // The zstd filter does not notice a truncated last frame, but the frame headers do
+        const io::mapped_file_source file(path);
+        zstd_frames(path, reinterpret_cast<const unsigned char*>(file.data()), file.size());
+        stream->push(io::zstd_decompressor());
+    }
+    stream->push(io::file_source(path, std::ios::binary));
+    return stream;
+}
+
+
+void read_decompressed_blocks(
+        const std::string& path,
+        const Compression compression,
+        const AsyncReadOptions& read_options,
+        const std::size_t threads,
+        const std::function<void(const char* data, std::size_t size)>& consume
+) {
+    switch (compression) {
+        case Compression::gzip:
+            inflate_gzip(path, read_options, consume);
+            break;
+        case Compression::zstd:
+            decompress_zstd(path, threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency()), consume);
+            break;
+        default:
+            read_file_blocks(path, 0, read_options, consume);
+            break;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <functional>
+#include <istream>
+#include <memory>
+#include <string>
+
+#include "async_reader.hpp"
+
+
+/**
+ * \brief   Compression of a catalog file, detected from its first bytes.
+ */
+enum class Compression {
+    none,
+    gzip,
+    zstd,
+};
+
+
+/**
+ * \throw   std::runtime_error if the file can not be opened
+ */
+Compression detect_compression(const std::string& path);
+
+
+const char* compression_name(const Compression compression) noexcept;
+
+
+/**
+ * \brief   Opens a catalog for reading line by line, decompressing gzip and zstd files on the fly.
+ *
+ * \throw   std::runtime_error if the file can not be opened
+ */
+std::unique_ptr<std::istream> open_catalog_stream(const std::string& path);
+
+
+/**
+ * \brief   Reads a compressed catalog and delivers the decompressed bytes in order.
+ *
+ * gzip is inflated on the calling thread while another thread keeps reads of
+ * the compressed file in flight. zstd files made of several frames (as
+ * written by pzstd, or zstd outputs of consecutive parts of the file
+ * concatenated) are decompressed frame by frame on `threads` worker threads.
+ * A single frame is decompressed as a stream. The zstd command line writes a
+ * single frame even with --block-size or -T.
+ *
+ * \param   threads     zstd worker threads; zero means one per hardware thread
+ * \param   consume     called on the calling thread with consecutive pieces of the decompressed file
+ * \throw   std::runtime_error if the file can not be read or is corrupt
+ */
+void read_decompressed_blocks(
+        const std::string& path,
+        const Compression compression,
+        const AsyncReadOptions& read_options,
+        const std::size_t threads,
+        const std::function<void(const char* data, std::size_t size)>& consume
+);
@@ -0,0 +1,112 @@
+#include "curve_order.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <boost/format.hpp>
+
+
+namespace {
+
+constexpr std::pair<StarOrder, const char*> ORDER_NAMES[] = {
+    {StarOrder::catalog, "catalog"},
+    {StarOrder::morton, "morton"},
+    {StarOrder::hilbert, "hilbert"},
+};
+
+
+/**
+ * \brief   Spreads the bits of v out to the even bit positions.
+ */
+uint64_t spread_bits(const uint32_t v) noexcept {
+    uint64_t x = v;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+    x = (x | (x << 2)) & 0x3333333333333333ull;
+    x = (x | (x << 1)) & 0x5555555555555555ull;
+    return x;
+}
+
+}
+
+
+StarOrder star_order(const std::string& name) {
+    for (const auto& [order, order_name] : ORDER_NAMES)
+        if (name == order_name)
+            return order;
+
+    throw std::runtime_error(
+        (
+            boost::format("Unknown star order: %1%") % name
+        ).str()
+    );
+}
+
+
+std::vector<std::string> star_order_names() {
+    std::vector<std::string> names;
+    for (const auto& [order, name] : ORDER_NAMES)
+        names.push_back(name);
+    return names;
+}
+
+
+uint64_t morton_index(
+        const uint32_t x,
+        const uint32_t y
+) noexcept {
+    return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+
+uint64_t hilbert_index(
+        uint32_t x,
+        uint32_t y,
+        const unsigned bits
+) noexcept {
+    uint64_t index = 0;
+    for (uint32_t s = bits != 0 ? uint32_t(1) << (bits - 1) : 0; s > 0; s >>= 1) {
+        const uint32_t rx = (x & s) != 0;
+        const uint32_t ry = (y & s) != 0;
+        index += uint64_t(s) * s * ((3 * rx) ^ ry);
+        // Rotate the quadrant so that the lower bits follow the curve; only bits below s matter from here on
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return index;
+}
+
+
+unsigned curve_bits(
+        const uint32_t width,
+        const uint32_t height
+) noexcept {
+    const uint32_t extent = std::max(width, height);
+    unsigned bits = 0;
+    while (bits < 32 && (uint64_t(1) << bits) < extent)
+        bits++;
+    return bits;
+}
+
+
+uint64_t curve_index(
+        const StarOrder order,
+        const uint32_t x,
+        const uint32_t y,
+        const unsigned bits
+) noexcept {
+    switch (order) {
+        case StarOrder::morton:
+            return morton_index(x, y);
+        case StarOrder::hilbert:
+            return hilbert_index(x, y, bits);
+        default:
+            return 0;
+    }
+}
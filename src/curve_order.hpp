@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+ * \brief   Order in which stars are plotted.
+ */
+enum class StarOrder {
+    /// As read from the catalog or cache
+    catalog,
+    /// Z-order curve over the output pixels
+    morton,
+    /// Hilbert curve over the output pixels
+    hilbert,
+};
+
+
+/**
+ * \throw   std::runtime_error for unknown names
+ */
+StarOrder star_order(const std::string& name);
+
+
+/**
+ * \return  names accepted by star_order()
+ */
+std::vector<std::string> star_order_names();
+
+
+/**
+ * \brief   Position of a cell on the Z-order curve, interleaving the bits of x and y.
+ */
+uint64_t morton_index(
+        const uint32_t x,
+        const uint32_t y
+) noexcept;
+
+
+/**
+ * \brief   Position of a cell on the Hilbert curve through a 2^bits by 2^bits grid.
+ *
+ * Unlike the Z-order curve, consecutive cells are always adjacent.
+ */
+uint64_t hilbert_index(
+        uint32_t x,
+        uint32_t y,
+        const unsigned bits
+) noexcept;
+
+
+/**
+ * \brief   Smallest number of bits that holds every coordinate of a width by height grid.
+ */
+unsigned curve_bits(
+        const uint32_t width,
+        const uint32_t height
+) noexcept;
+
+
+/**
+ * \brief   Position of a cell along the curve of the given order.
+ *
+ * \param   bits    see curve_bits()
+ * \return  zero for StarOrder::catalog, so that a stable sort keeps the input order
+ */
+uint64_t curve_index(
+        const StarOrder order,
+        const uint32_t x,
+        const uint32_t y,
+        const unsigned bits
+) noexcept;
@@ -0,0 +1,66 @@
+#include "delimiter_scanner.hpp"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+uint64_t delimiter_mask(
+        const char* block,
+        const char delimiter
+) noexcept {
+    uint64_t mask = 0;
+#if defined(__AVX2__)
+    const auto delimiters = _mm256_set1_epi8(delimiter);
+    const auto newlines = _mm256_set1_epi8('\n');
+    for (int i = 0; i < 2; i++) {
+        const auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * i));
+        const auto found = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, delimiters), _mm256_cmpeq_epi8(bytes, newlines));
+        mask |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(found))) << (32 * i);
+    }
+#elif defined(__SSE2__)
+    const auto delimiters = _mm_set1_epi8(delimiter);
+    const auto newlines = _mm_set1_epi8('\n');
+    for (int i = 0; i < 4; i++) {
+        const auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        const auto found = _mm_or_si128(_mm_cmpeq_epi8(bytes, delimiters), _mm_cmpeq_epi8(bytes, newlines));
+        mask |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(found))) << (16 * i);
+    }
+#else
+    for (int i = 0; i < 64; i++)
+        if (block[i] == delimiter || block[i] == '\n')
+            mask |= uint64_t(1) << i;
+#endif
+    return mask;
+}
+
+
+DelimiterScanner::DelimiterScanner(
+            const std::string_view text,
+            const char delimiter
+) noexcept:
+        text(text),
+        delimiter(delimiter)
+{
+}
+
+
+void DelimiterScanner::load_block() noexcept {
+    block = next_block;
+    next_block += 64;
+
+    const auto remaining = text.size() - block;
+    if (remaining >= 64) {
+        matches = delimiter_mask(text.data() + block, delimiter);
+        return;
+    }
+
+    // Pad the last block, and drop matches in the padding
+    char tail[64] = {};
+    std::memcpy(tail, text.data() + block, remaining);
+    matches = delimiter_mask(tail, delimiter) & ((uint64_t(1) << remaining) - 1);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+/**
+ * \brief   Bit i is set if byte i of the 64 bytes at block is the delimiter or '\n'.
+ *
+ * Compares 32 bytes at a time with AVX2 when compiled for it (see
+ * STARFINDER_NATIVE_ARCH), 16 with SSE2 otherwise, and falls back to a
+ * byte loop on other architectures.
+ */
+uint64_t delimiter_mask(
+        const char* block,
+        const char delimiter
+) noexcept;
+
+
+/**
+ * \brief   Finds the delimiters and line ends of catalog text in order.
+ *
+ * The text is scanned 64 bytes at a time into a bit mask of matches (see
+ * delimiter_mask()), which is then walked one set bit at a time, as simdjson
+ * finds its structural characters. Rows are not copied.
+ */
+class DelimiterScanner {
+    public:
+        DelimiterScanner(
+                const std::string_view text,
+                const char delimiter
+        ) noexcept;
+
+        /**
+         * \return  position of the next delimiter or '\n', or the size of the text after the last
+         */
+        std::size_t next() noexcept {
+            while (matches == 0) {
+                if (next_block >= text.size())
+                    return text.size();
+                load_block();
+            }
+            const auto bit = static_cast<std::size_t>(__builtin_ctzll(matches));
+            matches &= matches - 1;
+            return block + bit;
+        }
+
+    private:
+        void load_block() noexcept;
+
+        const std::string_view text;
+        const char delimiter;
+        /// Offset of the current block
+        std::size_t block = 0;
+        std::size_t next_block = 0;
+        /// Matches in the current block not returned yet
+        uint64_t matches = 0;
+};
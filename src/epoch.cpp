@@ -0,0 +1,53 @@
+#include "epoch.hpp"
+
+#include <cmath>
+
+#include "apparent.hpp"
+
+
+void propagate_epoch(
+        const MeanPositionColumns& src,
+        const double src_epoch,
+        const double dst_epoch,
+        StarColumns& dst
+) {
+    constexpr double mas_to_rad = M_PI / 180 / 3.6e6;
+
+    dst.ra_deg = src.ra_deg;
+    dst.de_deg = src.de_deg;
+    dst.mag = src.mag;
+    dst.mag_sources = src.mag_sources;
+
+    UnitVectorColumns vectors;
+    to_unit_vectors(dst, vectors);
+
+    const std::size_t count = vectors.size();
+    const double dt = dst_epoch - src_epoch;
+    const double* __restrict pm_ra = src.pm_ra_mas.data();
+    const double* __restrict pm_de = src.pm_de_mas.data();
+    double* __restrict x = vectors.x.data();
+    double* __restrict y = vectors.y.data();
+    double* __restrict z = vectors.z.data();
+
+    for (std::size_t i = 0; i < count; i++) {
+        // Displacement on the tangent plane, in radians
+        const double d_ra = pm_ra[i] * mas_to_rad * dt;
+        const double d_de = pm_de[i] * mas_to_rad * dt;
+
+        // p + d_ra * e_ra + d_de * e_de, with the local unit vectors
+        // e_ra = (-y, x, 0) / r and e_de = (-z x, -z y, r²) / r, r = cos(Dec).
+        // The tiny offset keeps stars on a pole finite (they only move in Dec)
+        // and is lost in rounding anywhere else
+        const double r = std::sqrt(x[i] * x[i] + y[i] * y[i]);
+        const double inv_r = 1 / (r + 1e-300);
+        const double u = x[i] - (d_ra * y[i] + d_de * z[i] * x[i]) * inv_r;
+        const double v = y[i] + (d_ra * x[i] - d_de * z[i] * y[i]) * inv_r;
+        const double w = z[i] + d_de * r;
+        const double inv_norm = 1 / std::sqrt(u * u + v * v + w * w);
+        x[i] = u * inv_norm;
+        y[i] = v * inv_norm;
+        z[i] = w * inv_norm;
+    }
+
+    from_unit_vectors(vectors, dst);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "star_columns.hpp"
+
+
+/// Epoch of the Tycho-2 mean positions (J2000.0), in Julian years.
+constexpr double TYCHO2_MEAN_EPOCH = 2000.0;
+
+
+/**
+ * \brief   Propagates mean positions to the target epoch along their proper motions.
+ *
+ * Positions are moved linearly on the tangent plane and renormalized onto the
+ * unit sphere. The move is done on unit vectors, as in apply_apparent_place(),
+ * so that only the conversions to and from RA/Dec call trigonometric functions
+ * and the displacement loop vectorizes (at -O3, the Release default).
+ *
+ * \param   src         mean positions and proper motions
+ * \param   src_epoch   epoch of the mean positions, Julian years
+ * \param   dst_epoch   target epoch, Julian years
+ * \param   dst         propagated positions; magnitudes are copied through
+ */
+void propagate_epoch(
+        const MeanPositionColumns& src,
+        const double src_epoch,
+        const double dst_epoch,
+        StarColumns& dst
+);
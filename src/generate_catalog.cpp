@@ -0,0 +1,83 @@
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include "synthetic_catalog.hpp"
+
+
+namespace po = boost::program_options;
+
+
+namespace {
+
+constexpr char OPT_HELP[] = "help";
+constexpr char OPT_OUTPUT[] = "output";
+constexpr char OPT_ROWS[] = "rows";
+constexpr char OPT_SEED[] = "seed";
+constexpr char OPT_DISK_FRACTION[] = "disk-fraction";
+constexpr char OPT_DISK_SCALE[] = "disk-scale";
+constexpr char OPT_MAX_MAGNITUDE[] = "max-magnitude";
+constexpr char OPT_BLANK_BT[] = "blank-bt";
+constexpr char OPT_BLANK_VT[] = "blank-vt";
+constexpr char OPT_MALFORMED[] = "malformed";
+constexpr char OPT_THREADS[] = "threads";
+
+}
+
+
+int main(int argc, char** argv) {
+    const SyntheticCatalogOptions defaults;
+    po::variables_map vm;
+    {
+        po::options_description options("Options");
+        options.add_options()
+            (OPT_HELP, "print this message")
+            (OPT_OUTPUT, po::value<std::string>()->default_value("synthetic_catalog.dat"), "Output catalog file name")
+            (OPT_ROWS, po::value<std::size_t>()->default_value(defaults.rows), "Number of rows (the real catalog.dat has 2539913)")
+            (OPT_SEED, po::value<uint64_t>()->default_value(defaults.seed), "Seed; the same seed and shape give the same file")
+            (OPT_DISK_FRACTION, po::value<double>()->default_value(defaults.disk_fraction), "Share of stars concentrated towards the galactic plane")
+            (OPT_DISK_SCALE, po::value<double>()->default_value(defaults.disk_scale), "Scale height of the galactic disk, in sin(galactic latitude)")
+            (OPT_MAX_MAGNITUDE, po::value<double>()->default_value(defaults.max_magnitude), "Faintest V magnitude")
+            (OPT_BLANK_BT, po::value<double>()->default_value(defaults.blank_bt_fraction), "Share of rows with a blank BT")
+            (OPT_BLANK_VT, po::value<double>()->default_value(defaults.blank_vt_fraction), "Share of rows with a blank VT")
+            (OPT_MALFORMED, po::value<double>()->default_value(defaults.malformed_fraction), "Share of rows that fail to parse")
+            (OPT_THREADS, po::value<std::size_t>()->default_value(0), "Formatting threads (0 for one per CPU)")
+        ;
+
+        po::store(po::parse_command_line(argc, argv, options), vm);
+        po::notify(vm);
+
+        if (vm.count(OPT_HELP) != 0) {
+            std::cout << "generate_catalog [options]" << std::endl << std::endl;
+            std::cout << options << std::endl;
+            return -1;
+        }
+    }
+
+    SyntheticCatalogOptions options;
+    options.rows = vm[OPT_ROWS].as<std::size_t>();
+    options.seed = vm[OPT_SEED].as<uint64_t>();
+    options.disk_fraction = vm[OPT_DISK_FRACTION].as<double>();
+    options.disk_scale = vm[OPT_DISK_SCALE].as<double>();
+    options.max_magnitude = vm[OPT_MAX_MAGNITUDE].as<double>();
+    options.blank_bt_fraction = vm[OPT_BLANK_BT].as<double>();
+    options.blank_vt_fraction = vm[OPT_BLANK_VT].as<double>();
+    options.malformed_fraction = vm[OPT_MALFORMED].as<double>();
+    options.threads = vm[OPT_THREADS].as<std::size_t>();
+
+    const auto& path = vm[OPT_OUTPUT].as<std::string>();
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        write_synthetic_catalog(path, options);
+    }
+    catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+
+    std::cout << boost::format("Wrote %1% rows to %2% in %3$.2f s") % options.rows % path % duration.count() << std::endl;
+    return 0;
+}
@@ -0,0 +1,719 @@
+#include "image_output.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <boost/format.hpp>
+#include <zlib.h>
+
+
+namespace {
+
+constexpr std::pair<ImageFormat, const char*> FORMAT_NAMES[] = {
+    {ImageFormat::automatic, "auto"},
+    {ImageFormat::png, "png"},
+    {ImageFormat::qoi, "qoi"},
+    {ImageFormat::pgm, "pgm"},
+    {ImageFormat::pfm, "pfm"},
+    {ImageFormat::tiff, "tiff"},
+    {ImageFormat::fits, "fits"},
+};
+
+constexpr std::pair<PngStrategy, const char*> STRATEGY_NAMES[] = {
+    {PngStrategy::default_strategy, "default"},
+    {PngStrategy::filtered, "filtered"},
+    {PngStrategy::huffman, "huffman"},
+    {PngStrategy::rle, "rle"},
+    {PngStrategy::fixed, "fixed"},
+};
+
+constexpr std::pair<const char*, ImageFormat> EXTENSION_FORMATS[] = {
+    {".png", ImageFormat::png},
+    {".qoi", ImageFormat::qoi},
+    {".pgm", ImageFormat::pgm},
+    {".pfm", ImageFormat::pfm},
+    {".tif", ImageFormat::tiff},
+    {".tiff", ImageFormat::tiff},
+    {".fits", ImageFormat::fits},
+    {".fit", ImageFormat::fits},
+    {".fts", ImageFormat::fits},
+};
+
+/// Filtered bytes a PNG strip aims for; smaller strips compress a little worse
+constexpr std::size_t PNG_STRIP_BYTES = 1 << 20;
+
+/// Bytes of the previous strip a strip's deflate stream starts from, as in one stream
+constexpr std::size_t DEFLATE_WINDOW = 32 << 10;
+
+/// FITS headers and data are padded to whole blocks of this size
+constexpr std::size_t FITS_BLOCK = 2880;
+
+/// Bytes of big-endian FITS rows written at a time
+constexpr std::size_t FITS_WRITE_BYTES = 1 << 20;
+
+
+void append_u32_be(
+        std::vector<uint8_t>& out,
+        const uint32_t value
+) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+
+void append_text(
+        std::vector<uint8_t>& out,
+        const std::string& text
+) {
+    out.insert(out.end(), text.cbegin(), text.cend());
+}
+
+
+int zlib_strategy(const PngStrategy strategy) noexcept {
+    switch (strategy) {
+        case PngStrategy::filtered:
+            return Z_FILTERED;
+        case PngStrategy::huffman:
+            return Z_HUFFMAN_ONLY;
+        case PngStrategy::rle:
+            return Z_RLE;
+        case PngStrategy::fixed:
+            return Z_FIXED;
+        default:
+            return Z_DEFAULT_STRATEGY;
+    }
+}
+
+
+uint8_t paeth(
+        const int a,
+        const int b,
+        const int c
+) noexcept {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+
+std::runtime_error unsupported_depth(
+        const char* format,
+        const cv::Mat& img
+) {
+    return std::runtime_error(
+        (
+            boost::format("%1% can not hold %2% pixels") % format % (img.depth() == CV_16U ? "16-bit" : "float")
+        ).str()
+    );
+}
+
+
+/**
+ * \brief   Filters one row of a grayscale image, as the filter byte and the filtered bytes.
+ *
+ * The fastest levels use the Sub filter, like cv::imwrite; the others pick
+ * the filter with the smallest sum of absolute differences, as libpng does.
+ *
+ * \param   row     in PNG byte order
+ * \param   prior   previous row, or nullptr for the first
+ * \param   size    bytes in the row
+ * \param   bytes_per_pixel     distance to the byte a filter takes as the left one
+ */
+void filter_row(
+        const uint8_t* row,
+        const uint8_t* prior,
+        const std::size_t size,
+        const std::size_t bytes_per_pixel,
+        const bool adaptive,
+        uint8_t* out
+) {
+    const auto filtered = [&] (const int filter, const std::size_t x) -> uint8_t {
+        const bool first = x < bytes_per_pixel;
+        const int left = first ? 0 : row[x - bytes_per_pixel];
+        const int up = prior ? prior[x] : 0;
+        const int up_left = prior && !first ? prior[x - bytes_per_pixel] : 0;
+        switch (filter) {
+            case 1:
+                return row[x] - left;
+            case 2:
+                return row[x] - up;
+            case 3:
+                return row[x] - ((left + up) >> 1);
+            case 4:
+                return row[x] - paeth(left, up, up_left);
+            default:
+                return row[x];
+        }
+    };
+
+    int best = 1;
+    if (adaptive) {
+        uint64_t best_sum = UINT64_MAX;
+        for (int filter = 0; filter < 5; filter++) {
+            uint64_t sum = 0;
+            for (std::size_t x = 0; x < size; x++)
+                sum += std::abs(static_cast<int8_t>(filtered(filter, x)));
+            if (sum < best_sum) {
+                best_sum = sum;
+                best = filter;
+            }
+        }
+    }
+
+    out[0] = best;
+    for (std::size_t x = 0; x < size; x++)
+        out[x + 1] = filtered(best, x);
+}
+
+
+/**
+ * \brief   Deflates one strip of the filtered image data as part of a single zlib stream.
+ *
+ * Every strip but the last ends with a sync flush, so the strips concatenate
+ * to one deflate stream; each starts from the last 32 KiB of the strip
+ * before it, so little compression is lost at the seams.
+ */
+std::vector<uint8_t> deflate_strip(
+        const uint8_t* data,
+        const std::size_t size,
+        const uint8_t* dictionary,
+        const std::size_t dictionary_size,
+        const bool last,
+        const ImageOptions& options
+) {
+    z_stream stream{};
+    if (deflateInit2(&stream, options.png_level, Z_DEFLATED, -15, 8, zlib_strategy(options.png_strategy)) != Z_OK)
+        throw std::runtime_error("Failed to initialize zlib");
+    if (dictionary_size != 0)
+        deflateSetDictionary(&stream, dictionary, dictionary_size);
+
+    std::vector<uint8_t> out(deflateBound(&stream, size) + 16);
+    stream.next_in = const_cast<uint8_t*>(data);
+    stream.avail_in = size;
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+    const int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    const bool failed = last ? result != Z_STREAM_END : result != Z_OK;
+    out.resize(out.size() - stream.avail_out);
+    deflateEnd(&stream);
+    if (failed)
+        throw std::runtime_error("Failed to compress the image");
+    return out;
+}
+
+
+void append_png_chunk(
+        std::vector<uint8_t>& out,
+        const char* type,
+        const uint8_t* data,
+        const std::size_t size
+) {
+    append_u32_be(out, size);
+    const auto start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    append_u32_be(out, crc32(0, out.data() + start, size + 4));
+}
+
+
+/**
+ * \brief   Row y of the image in PNG (and PGM) byte order, which for 16-bit pixels is big-endian.
+ *
+ * \param   buffer  holds the row if it has to be converted
+ */
+const uint8_t* png_row(
+        const cv::Mat& img,
+        const int y,
+        std::vector<uint8_t>& buffer
+) {
+    if (img.depth() == CV_8U)
+        return img.ptr<uint8_t>(y);
+
+    buffer.resize(img.cols * sizeof(uint16_t));
+    const auto* row = img.ptr<uint16_t>(y);
+    for (int x = 0; x < img.cols; x++) {
+        buffer[2 * x] = row[x] >> 8;
+        buffer[2 * x + 1] = row[x];
+    }
+    return buffer.data();
+}
+
+
+std::vector<uint8_t> encode_png(
+        const cv::Mat& img,
+        const ImageOptions& options
+) {
+    if (img.depth() == CV_32F)
+        throw unsupported_depth("PNG", img);
+
+    const std::size_t width = img.cols;
+    const std::size_t height = img.rows;
+    const std::size_t bytes_per_pixel = img.elemSize();
+    const std::size_t stride = width * bytes_per_pixel + 1;
+    if (options.png_level < 0 || options.png_level > 9)
+        throw std::runtime_error(
+            (
+                boost::format("PNG level %1% is not between 0 and 9") % options.png_level
+            ).str()
+        );
+
+    const std::size_t threads = options.threads != 0
+        ? options.threads
+        : std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t strip_rows = std::max<std::size_t>(1, PNG_STRIP_BYTES / stride);
+    const std::size_t strips = std::max<std::size_t>(1, (height + strip_rows - 1) / strip_rows);
+    const bool adaptive = options.png_level > 1;
+
+    // Filter and deflate the strips on a few threads, each taking every threads-th strip
+    std::vector<uint8_t> filtered(stride * height);
+    std::vector<std::vector<uint8_t>> deflated(strips);
+    std::vector<uLong> checksums(strips);
+    const auto filter_strip = [&] (const std::size_t strip) {
+        const auto first = strip * strip_rows;
+        const auto last = std::min(height, first + strip_rows);
+        // Rows converted to PNG byte order alternate between two buffers
+        std::vector<uint8_t> buffers[2];
+        const uint8_t* prior = first > 0 ? png_row(img, first - 1, buffers[(first - 1) % 2]) : nullptr;
+        for (std::size_t y = first; y < last; y++) {
+            const auto* row = png_row(img, y, buffers[y % 2]);
+            filter_row(row, prior, stride - 1, bytes_per_pixel, adaptive, &filtered[y * stride]);
+            prior = row;
+        }
+        checksums[strip] = adler32(1, &filtered[first * stride], (last - first) * stride);
+    };
+    const auto compress_strip = [&] (const std::size_t strip) {
+        const auto begin = strip * strip_rows * stride;
+        const auto end = std::min(height, (strip + 1) * strip_rows) * stride;
+        const auto dictionary = std::min(begin, DEFLATE_WINDOW);
+        deflated[strip] = deflate_strip(&filtered[begin], end - begin, &filtered[begin - dictionary], dictionary, strip + 1 == strips, options);
+    };
+    const auto run = [&] (const auto& work) {
+        std::vector<std::future<void>> workers;
+        for (std::size_t t = 0; t < std::min(threads, strips); t++)
+            workers.push_back(
+                std::async(
+                    std::launch::async,
+                    [&, t] {
+                        for (std::size_t strip = t; strip < strips; strip += threads)
+                            work(strip);
+                    }
+                )
+            );
+        for (auto& worker : workers)
+            worker.get();
+    };
+    // The dictionary of a strip is the filtered data before it, so all rows are filtered first
+    run(filter_strip);
+    run(compress_strip);
+
+    uLong checksum = 1;
+    for (std::size_t strip = 0; strip < strips; strip++) {
+        const auto first = strip * strip_rows;
+        const auto last = std::min(height, first + strip_rows);
+        checksum = adler32_combine(checksum, checksums[strip], (last - first) * stride);
+    }
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    std::vector<uint8_t> header;
+    append_u32_be(header, width);
+    append_u32_be(header, height);
+    header.insert(header.end(), {static_cast<uint8_t>(8 * bytes_per_pixel), 0, 0, 0, 0});
+    append_png_chunk(png, "IHDR", header.data(), header.size());
+
+    // zlib header: deflate with a 32 KiB window, and the level class; FCHECK makes it a multiple of 31
+    const uint8_t level_class = options.png_level <= 1 ? 0 : options.png_level <= 5 ? 1 : options.png_level == 6 ? 2 : 3;
+    uint8_t zlib_header[2] = {0x78, static_cast<uint8_t>(level_class << 6)};
+    zlib_header[1] += 31 - (zlib_header[0] * 256 + zlib_header[1]) % 31;
+    deflated.front().insert(deflated.front().begin(), zlib_header, zlib_header + 2);
+    for (int shift = 24; shift >= 0; shift -= 8)
+        deflated.back().push_back(checksum >> shift);
+
+    for (const auto& strip : deflated)
+        append_png_chunk(png, "IDAT", strip.data(), strip.size());
+    append_png_chunk(png, "IEND", nullptr, 0);
+    return png;
+}
+
+
+/**
+ * \brief   QOI of the image, as RGB with equal channels.
+ *
+ * \see     https://qoiformat.org/qoi-specification.pdf
+ */
+std::vector<uint8_t> encode_qoi(const cv::Mat& img) {
+    if (img.depth() != CV_8U)
+        throw unsupported_depth("QOI", img);
+
+    std::vector<uint8_t> out;
+    append_text(out, "qoif");
+    append_u32_be(out, img.cols);
+    append_u32_be(out, img.rows);
+    out.push_back(3);
+    out.push_back(0);
+
+    uint8_t index[64] = {};
+    bool indexed[64] = {};
+    // The pixel before the first is opaque black
+    uint8_t previous = 0;
+    unsigned run = 0;
+    const auto flush_run = [&] {
+        if (run != 0)
+            out.push_back(0xc0 | (run - 1));
+        run = 0;
+    };
+    for (int y = 0; y < img.rows; y++) {
+        const auto* row = img.ptr<uint8_t>(y);
+        for (int x = 0; x < img.cols; x++) {
+            const uint8_t v = row[x];
+            if (v == previous) {
+                if (++run == 62)
+                    flush_run();
+                continue;
+            }
+            flush_run();
+
+            // Hash of (v, v, v, 255)
+            const unsigned slot = (v * 3 + v * 5 + v * 7 + 255 * 11) % 64;
+            if (indexed[slot] && index[slot] == v) {
+                out.push_back(slot);
+            } else {
+                index[slot] = v;
+                indexed[slot] = true;
+                const int diff = static_cast<int>(v) - previous;
+                if (diff >= -2 && diff <= 1) {
+                    out.push_back(0x40 | (diff + 2) << 4 | (diff + 2) << 2 | (diff + 2));
+                } else if (diff >= -32 && diff <= 31) {
+                    // Luma: green difference, red and blue the same as green
+                    out.push_back(0x80 | (diff + 32));
+                    out.push_back(0x88);
+                } else {
+                    out.push_back(0xfe);
+                    out.push_back(v);
+                    out.push_back(v);
+                    out.push_back(v);
+                }
+            }
+            previous = v;
+        }
+    }
+    flush_run();
+    out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+    return out;
+}
+
+
+/**
+ * \brief   PGM of the image; 16-bit pixels are big-endian.
+ */
+std::vector<uint8_t> encode_pgm(const cv::Mat& img) {
+    if (img.depth() == CV_32F)
+        throw unsupported_depth("PGM", img);
+
+    std::vector<uint8_t> out;
+    const int max_value = img.depth() == CV_16U ? 65535 : 255;
+    append_text(out, (boost::format("P5\n%1% %2%\n%3%\n") % img.cols % img.rows % max_value).str());
+    std::vector<uint8_t> buffer;
+    for (int y = 0; y < img.rows; y++) {
+        const auto* row = png_row(img, y, buffer);
+        out.insert(out.end(), row, row + img.cols * img.elemSize());
+    }
+    return out;
+}
+
+
+/**
+ * \brief   PFM of the image, brightness scaled to 0..1; rows run bottom to top, little-endian.
+ */
+std::vector<uint8_t> encode_pfm(const cv::Mat& img) {
+    std::vector<uint8_t> out;
+    append_text(out, (boost::format("Pf\n%1% %2%\n-1.0\n") % img.cols % img.rows).str());
+    const auto header = out.size();
+    out.resize(header + static_cast<std::size_t>(img.cols) * img.rows * sizeof(float));
+    auto* pixels = out.data() + header;
+    std::vector<float> values(img.cols);
+    for (int y = img.rows - 1; y >= 0; y--) {
+        for (int x = 0; x < img.cols; x++)
+            switch (img.depth()) {
+                case CV_8U:
+                    values[x] = img.ptr<uint8_t>(y)[x] / 255.0f;
+                    break;
+                case CV_16U:
+                    values[x] = img.ptr<uint16_t>(y)[x] / 65535.0f;
+                    break;
+                default:
+                    values[x] = img.ptr<float>(y)[x];
+            }
+        for (const float value : values) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            for (int shift = 0; shift < 32; shift += 8)
+                *pixels++ = bits >> shift;
+        }
+    }
+    return out;
+}
+
+
+/**
+ * \brief   One 80-character header card; string values are quoted, others right-justified.
+ */
+std::string fits_card(
+        const std::string& keyword,
+        const std::string& value,
+        const std::string& comment = ""
+) {
+    auto card = (
+        boost::format(value.front() == '\'' ? "%-8s= %-20s" : "%-8s= %20s") % keyword % value
+    ).str();
+    if (!comment.empty())
+        card += " / " + comment;
+    card.resize(80, ' ');
+    return card;
+}
+
+
+std::string fits_string(const std::string& text) {
+    // Strings are at least 8 characters long
+    return (boost::format("'%-8s'") % text).str();
+}
+
+
+std::string fits_real(const double value) {
+    auto text = (boost::format("%.15G") % value).str();
+    if (text.find_first_of(".E") == std::string::npos)
+        text += ".0";
+    return text;
+}
+
+
+std::vector<uint8_t> encode_fits(
+        const cv::Mat& img,
+        const ImageOptions& options
+) {
+    std::ostringstream stream;
+    write_fits(stream, img, options.window);
+    const auto fits = stream.str();
+    return std::vector<uint8_t>(fits.cbegin(), fits.cend());
+}
+
+
+ImageFormat resolve_format(
+        const ImageFormat format,
+        const std::string& extension
+) {
+    if (format != ImageFormat::automatic)
+        return format;
+
+    std::string lower = extension;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [] (unsigned char c) { return std::tolower(c); });
+    for (const auto& [format_extension, extension_format] : EXTENSION_FORMATS)
+        if (lower == format_extension)
+            return extension_format;
+    return ImageFormat::automatic;
+}
+
+}
+
+
+ImageFormat image_format(const std::string& name) {
+    for (const auto& [format, format_name] : FORMAT_NAMES)
+        if (name == format_name)
+            return format;
+
+    throw std::runtime_error(
+        (
+            boost::format("Unknown image format: %1%") % name
+        ).str()
+    );
+}
+
+
+const char* image_format_name(const ImageFormat format) noexcept {
+    for (const auto& [f, name] : FORMAT_NAMES)
+        if (f == format)
+            return name;
+    return "unknown";
+}
+
+
+std::vector<std::string> image_format_names() {
+    std::vector<std::string> names;
+    for (const auto& [format, name] : FORMAT_NAMES)
+        names.push_back(name);
+    return names;
+}
+
+
+PngStrategy png_strategy(const std::string& name) {
+    for (const auto& [strategy, strategy_name] : STRATEGY_NAMES)
+        if (name == strategy_name)
+            return strategy;
+
+    throw std::runtime_error(
+        (
+            boost::format("Unknown PNG strategy: %1%") % name
+        ).str()
+    );
+}
+
+
+std::vector<std::string> png_strategy_names() {
+    std::vector<std::string> names;
+    for (const auto& [strategy, name] : STRATEGY_NAMES)
+        names.push_back(name);
+    return names;
+}
+
+
+void write_fits(
+        std::ostream& out,
+        const cv::Mat& img,
+        const std::optional<SkyWindow>& window
+) {
+    const int bitpix = img.depth() == CV_32F ? -32 : 8 * static_cast<int>(img.elemSize());
+    std::vector<std::string> cards = {
+        fits_card("SIMPLE", "T", "conforms to FITS standard"),
+        fits_card("BITPIX", std::to_string(bitpix), "array data type"),
+        fits_card("NAXIS", "2", "number of array dimensions"),
+        fits_card("NAXIS1", std::to_string(img.cols)),
+        fits_card("NAXIS2", std::to_string(img.rows)),
+    };
+    if (img.depth() == CV_16U) {
+        cards.push_back(fits_card("BZERO", "32768", "unsigned 16-bit pixels"));
+        cards.push_back(fits_card("BSCALE", "1"));
+    }
+    cards.push_back(fits_card("ORIGIN", fits_string("starfinder")));
+    if (window) {
+        // Pixel centres sit half a step into the window; with the reference on
+        // the equator, CAR maps RA and Dec linearly onto x and y
+        const double ra_step = (window->max_ra - window->min_ra) / img.cols;
+        const double dec_step = (window->max_dec - window->min_dec) / img.rows;
+        const double reference_ra = (window->min_ra + window->max_ra) / 2;
+        cards.push_back(fits_card("WCSAXES", "2"));
+        cards.push_back(fits_card("CTYPE1", fits_string("RA---CAR")));
+        cards.push_back(fits_card("CTYPE2", fits_string("DEC--CAR")));
+        cards.push_back(fits_card("CUNIT1", fits_string("deg")));
+        cards.push_back(fits_card("CUNIT2", fits_string("deg")));
+        cards.push_back(fits_card("CRPIX1", fits_real(0.5 + (reference_ra - window->min_ra) / ra_step)));
+        cards.push_back(fits_card("CRPIX2", fits_real(0.5 - window->min_dec / dec_step)));
+        cards.push_back(fits_card("CRVAL1", fits_real(reference_ra)));
+        cards.push_back(fits_card("CRVAL2", "0.0"));
+        cards.push_back(fits_card("CDELT1", fits_real(ra_step)));
+        cards.push_back(fits_card("CDELT2", fits_real(dec_step)));
+        cards.push_back(fits_card("RADESYS", fits_string("ICRS")));
+        if (window->epoch)
+            cards.push_back(fits_card("MJD-OBS", fits_real(51544.5 + (*window->epoch - 2000) * 365.25), "epoch of the positions"));
+    }
+    cards.push_back(std::string("END").append(77, ' '));
+
+    std::string header;
+    for (const auto& card : cards)
+        header += card;
+    header.resize((header.size() + FITS_BLOCK - 1) / FITS_BLOCK * FITS_BLOCK, ' ');
+    out.write(header.data(), header.size());
+
+    const std::size_t row_bytes = img.cols * img.elemSize();
+    const std::size_t buffer_rows = std::max<std::size_t>(1, FITS_WRITE_BYTES / std::max<std::size_t>(1, row_bytes));
+    std::vector<uint8_t> buffer(buffer_rows * row_bytes);
+    for (int first = 0; first < img.rows; first += buffer_rows) {
+        const int last = std::min<int>(img.rows, first + buffer_rows);
+        auto* bytes = buffer.data();
+        for (int y = first; y < last; y++) {
+            switch (img.depth()) {
+                case CV_8U:
+                    std::memcpy(bytes, img.ptr<uint8_t>(y), row_bytes);
+                    bytes += row_bytes;
+                    break;
+                case CV_16U:
+                    for (int x = 0; x < img.cols; x++) {
+                        const uint16_t stored = img.ptr<uint16_t>(y)[x] ^ 0x8000;
+                        *bytes++ = stored >> 8;
+                        *bytes++ = stored;
+                    }
+                    break;
+                default:
+                    for (int x = 0; x < img.cols; x++) {
+                        uint32_t bits;
+                        std::memcpy(&bits, &img.ptr<float>(y)[x], sizeof(bits));
+                        for (int shift = 24; shift >= 0; shift -= 8)
+                            *bytes++ = bits >> shift;
+                    }
+            }
+        }
+        out.write(reinterpret_cast<const char*>(buffer.data()), bytes - buffer.data());
+    }
+
+    const std::size_t data_bytes = row_bytes * img.rows;
+    const std::string padding((FITS_BLOCK - data_bytes % FITS_BLOCK) % FITS_BLOCK, '\0');
+    out.write(padding.data(), padding.size());
+}
+
+
+std::vector<uint8_t> encode_image(
+        const cv::Mat& img,
+        const std::string& extension,
+        const ImageOptions& options
+) {
+    const auto format = resolve_format(options.format, extension);
+    switch (format) {
+        case ImageFormat::png:
+            return encode_png(img, options);
+        case ImageFormat::qoi:
+            return encode_qoi(img);
+        case ImageFormat::pgm:
+            return encode_pgm(img);
+        case ImageFormat::pfm:
+            return encode_pfm(img);
+        case ImageFormat::fits:
+            return encode_fits(img, options);
+        default: {
+            std::vector<uint8_t> encoded;
+            cv::imencode(format == ImageFormat::tiff ? ".tiff" : extension, img, encoded);
+            return encoded;
+        }
+    }
+}
+
+
+void write_image(
+        const std::string& path,
+        const cv::Mat& img,
+        const ImageOptions& options,
+        Metrics* metrics
+) {
+    const auto extension = std::filesystem::path(path).extension().string();
+    const auto format = resolve_format(options.format, extension);
+    std::vector<uint8_t> encoded;
+    if (format != ImageFormat::fits) {
+        const StageTimer encode_timer(metrics, Stage::encode);
+        encoded = encode_image(img, extension, options);
+    }
+
+    const StageTimer write_timer(metrics, Stage::write);
+    std::ofstream file(path, std::ios::binary);
+    // FITS rows are converted as they are written, so that time counts as write
+    if (format == ImageFormat::fits)
+        write_fits(file, img, options.window);
+    else
+        file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    if (!file)
+        throw std::runtime_error(
+            (
+                boost::format("Failed to write image %1%") % path
+            ).str()
+        );
+}
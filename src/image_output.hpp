@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "metrics.hpp"
+
+
+/**
+ * \brief   File format of the rendered image.
+ */
+enum class ImageFormat {
+    /// From the file name extension; extensions not listed here are left to OpenCV
+    automatic,
+    /// PNG, 8 or 16-bit, deflated in parallel row strips
+    png,
+    /// The Quite OK Image format, a fast lossless format for 8-bit images
+    qoi,
+    /// Binary portable graymap, 8 or 16-bit, uncompressed
+    pgm,
+    /// Portable float map, one 32-bit float per pixel
+    pfm,
+    /// TIFF, encoded by OpenCV
+    tiff,
+    /// FITS with a WCS, written row by row
+    fits,
+};
+
+
+/**
+ * \brief   zlib strategy of the PNG encoder.
+ */
+enum class PngStrategy {
+    default_strategy,
+    filtered,
+    huffman,
+    rle,
+    fixed,
+};
+
+
+/**
+ * \brief   Sky window an image covers, with RA and Dec linear in x and y as render_stars() maps them.
+ */
+struct SkyWindow {
+    double min_ra;
+    double max_ra;
+    double min_dec;
+    double max_dec;
+    /// Julian epoch of the positions, if they were propagated
+    std::optional<double> epoch;
+};
+
+
+/**
+ * \brief   How the rendered image is encoded.
+ *
+ * The PNG defaults match those of cv::imwrite: the fastest level and RLE.
+ */
+struct ImageOptions {
+    ImageFormat format = ImageFormat::automatic;
+    /// zlib level, 0 (stored) to 9 (smallest)
+    int png_level = 1;
+    PngStrategy png_strategy = PngStrategy::rle;
+    /// Threads deflating PNG row strips; zero means one per hardware thread
+    std::size_t threads = 0;
+    /// Window of the image, for the WCS of FITS images; none is written if not set
+    std::optional<SkyWindow> window;
+};
+
+
+/**
+ * \throw   std::runtime_error for unknown names
+ */
+ImageFormat image_format(const std::string& name);
+
+
+const char* image_format_name(const ImageFormat format) noexcept;
+
+
+/**
+ * \return  names accepted by image_format()
+ */
+std::vector<std::string> image_format_names();
+
+
+/**
+ * \throw   std::runtime_error for unknown names
+ */
+PngStrategy png_strategy(const std::string& name);
+
+
+/**
+ * \return  names accepted by png_strategy()
+ */
+std::vector<std::string> png_strategy_names();
+
+
+/**
+ * \brief   Writes a grayscale image as a FITS primary HDU.
+ *
+ * Rows are converted to big-endian a few at a time and written in large
+ * blocks, so the image is never held twice. The first row of the image is
+ * the first FITS row, at the bottom in FITS viewers, which puts the lowest
+ * Dec at the bottom. 16-bit pixels are stored with BZERO = 32768.
+ *
+ * \param   window  if set, described by a plate carrée (CAR) WCS
+ */
+void write_fits(
+        std::ostream& out,
+        const cv::Mat& img,
+        const std::optional<SkyWindow>& window
+);
+
+
+/**
+ * \brief   Encodes a grayscale image of 8-bit, 16-bit or float pixels.
+ *
+ * \param   extension   file name extension, for ImageFormat::automatic
+ * \throw   std::runtime_error if the format can not hold the image
+ */
+std::vector<uint8_t> encode_image(
+        const cv::Mat& img,
+        const std::string& extension,
+        const ImageOptions& options
+);
+
+
+/**
+ * \brief   Encodes the image and writes it to a file.
+ *
+ * \param   metrics if set, receives the encode and write times
+ * \throw   std::runtime_error if the file can not be written
+ */
+void write_image(
+        const std::string& path,
+        const cv::Mat& img,
+        const ImageOptions& options,
+        Metrics* metrics = nullptr
+);
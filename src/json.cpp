@@ -0,0 +1,20 @@
+#include "json.hpp"
+
+#include <boost/format.hpp>
+
+
+void write_json_string(
+        std::ostream& out,
+        const std::string& text
+) {
+    out << '"';
+    for (const char c : text) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << boost::format("\\u%1$04x") % static_cast<int>(c);
+        else
+            out << c;
+    }
+    out << '"';
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+
+/**
+ * \brief   Writes a JSON string literal, escaping quotes, backslashes and control characters.
+ *
+ * Metrics quote catalog text in skip reasons, and traces thread names.
+ */
+void write_json_string(
+        std::ostream& out,
+        const std::string& text
+);
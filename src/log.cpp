@@ -0,0 +1,134 @@
+#include "log.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+std::atomic<LogLevel> log_level{LogLevel::progress};
+
+std::atomic<std::size_t> progress_interval{10000};
+
+
+/**
+ * \brief   Writes queued lines on its own thread.
+ */
+class LogWriter {
+    public:
+        LogWriter():
+                thread([this] { run(); })
+        {}
+
+        ~LogWriter() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            ready.notify_one();
+            thread.join();
+        }
+
+        void push(
+                const LogLevel level,
+                std::string line
+        ) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                lines.emplace_back(level, std::move(line));
+            }
+            ready.notify_one();
+        }
+
+        void flush() {
+            std::unique_lock<std::mutex> lock(mutex);
+            drained.wait(lock, [this] { return lines.empty() && !writing; });
+        }
+
+    private:
+        void run() {
+            std::vector<std::pair<LogLevel, std::string>> batch;
+            std::ostream* last = nullptr;
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                ready.wait(lock, [this] { return stopping || !lines.empty(); });
+                if (lines.empty())
+                    break;
+                batch.swap(lines);
+                writing = true;
+                lock.unlock();
+
+                for (const auto& [level, line] : batch) {
+                    std::ostream& out = level == LogLevel::error ? std::cerr : std::cout;
+                    // Keep the order of stdout and stderr lines on a shared terminal
+                    if (last && last != &out)
+                        last->flush();
+                    out << line << '\n';
+                    last = &out;
+                }
+                if (last)
+                    last->flush();
+                batch.clear();
+
+                lock.lock();
+                writing = false;
+                drained.notify_all();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::condition_variable drained;
+        std::vector<std::pair<LogLevel, std::string>> lines;
+        bool writing = false;
+        bool stopping = false;
+        // Last, so that it starts after the members it uses
+        std::thread thread;
+};
+
+
+LogWriter& log_writer() {
+    static LogWriter writer;
+    return writer;
+}
+
+}
+
+
+void set_log_level(const LogLevel level) noexcept {
+    log_level = level;
+}
+
+
+bool log_enabled(const LogLevel level) noexcept {
+    return level <= log_level.load(std::memory_order_relaxed);
+}
+
+
+void set_progress_interval(const std::size_t rows) noexcept {
+    progress_interval = rows;
+}
+
+
+bool log_progress_row(const std::size_t row) noexcept {
+    const auto interval = progress_interval.load(std::memory_order_relaxed);
+    return interval != 0 && (row % interval) == 0 && log_enabled(LogLevel::progress);
+}
+
+
+void log_line(
+        const LogLevel level,
+        std::string line
+) {
+    log_writer().push(level, std::move(line));
+}
+
+
+void flush_log() {
+    log_writer().flush();
+}
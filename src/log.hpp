@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <boost/format.hpp>
+
+
+/**
+ * \brief   Console messages, from the most to the least important.
+ */
+enum class LogLevel {
+    /// Skipped rows and failures, on stderr
+    error,
+    /// Settings, totals and timings
+    info,
+    /// A line per star: every few thousand catalog rows, and the first stars in the window
+    progress,
+};
+
+
+/**
+ * \brief   Sets the least important level written; progress by default.
+ */
+void set_log_level(const LogLevel level) noexcept;
+
+
+bool log_enabled(const LogLevel level) noexcept;
+
+
+/**
+ * \brief   Sets how many catalog rows apart progress lines are; zero turns them off.
+ */
+void set_progress_interval(const std::size_t rows) noexcept;
+
+
+/**
+ * \brief   Whether catalog row \p row gets a progress line.
+ */
+bool log_progress_row(const std::size_t row) noexcept;
+
+
+/**
+ * \brief   Queues a line for the writer thread.
+ *
+ * Lines are written in the order they are queued, to stdout or (for errors)
+ * stderr, and the streams are flushed only when the queue runs empty, so the
+ * calling thread never waits for the console.
+ */
+void log_line(
+        const LogLevel level,
+        std::string line
+);
+
+
+/**
+ * \brief   Waits until every queued line is written.
+ */
+void flush_log();
+
+
+/**
+ * \brief   Formats a message with boost::format and queues it, if its level is enabled.
+ *
+ * Nothing is formatted for disabled levels.
+ */
+template <class... Args>
+void log_message(
+        const LogLevel level,
+        const char* format,
+        const Args&... args
+) {
+    if (!log_enabled(level))
+        return;
+    boost::format message(format);
+    ((message % args), ...);
+    log_line(level, message.str());
+}
+
+
+template <class... Args>
+void log_error(
+        const char* format,
+        const Args&... args
+) {
+    log_message(LogLevel::error, format, args...);
+}
+
+
+template <class... Args>
+void log_info(
+        const char* format,
+        const Args&... args
+) {
+    log_message(LogLevel::info, format, args...);
+}
+
+
+template <class... Args>
+void log_progress(
+        const char* format,
+        const Args&... args
+) {
+    log_message(LogLevel::progress, format, args...);
+}
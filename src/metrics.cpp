@@ -0,0 +1,151 @@
+#include "metrics.hpp"
+
+#include <utility>
+#include <boost/format.hpp>
+
+#include "json.hpp"
+
+
+namespace {
+
+constexpr std::pair<Stage, const char*> STAGE_NAMES[] = {
+    {Stage::open, "open"},
+    {Stage::read, "read"},
+    {Stage::tokenize, "tokenize"},
+    {Stage::parse, "parse"},
+    {Stage::filter, "filter"},
+    {Stage::minmax, "minmax"},
+    {Stage::project, "project"},
+    {Stage::rasterize, "rasterize"},
+    {Stage::encode, "encode"},
+    {Stage::write, "write"},
+};
+
+constexpr std::pair<Counter, const char*> COUNTER_NAMES[] = {
+    {Counter::rows, "rows"},
+    {Counter::bytes, "bytes"},
+    {Counter::skipped_rows, "skipped_rows"},
+    {Counter::stars_plotted, "stars_plotted"},
+    {Counter::stars_clipped, "stars_clipped"},
+};
+
+}
+
+
+Metrics::Metrics():
+        start(Clock::now())
+{}
+
+
+void Metrics::add_time(
+        const Stage stage,
+        const Clock::duration duration,
+        const uint64_t spans
+) noexcept {
+    const auto i = static_cast<std::size_t>(stage);
+    stage_ns[i] += std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    stage_spans[i] += spans;
+}
+
+
+void Metrics::add_count(
+        const Counter counter,
+        const uint64_t value
+) noexcept {
+    counters[static_cast<std::size_t>(counter)] += value;
+}
+
+
+void Metrics::add_skipped_rows(
+        const std::string& reason,
+        const uint64_t rows
+) {
+    std::lock_guard<std::mutex> lock(mutex);
+    skip_reasons[reason] += rows;
+}
+
+
+void Metrics::write_json(std::ostream& out) const {
+    const auto wall = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+
+    out << "{\n";
+    out << "  \"wall_ns\": " << wall.count() << ",\n";
+    out << "  \"stages\": {";
+    for (std::size_t i = 0; i < STAGES; i++) {
+        out << (i == 0 ? "\n" : ",\n");
+        out << boost::format("    \"%1%\": {\"ns\": %2%, \"spans\": %3%}") % stage_name(static_cast<Stage>(i)) % stage_ns[i].load() % stage_spans[i].load();
+    }
+    out << "\n  },\n";
+    out << "  \"counters\": {";
+    for (std::size_t i = 0; i < COUNTERS; i++) {
+        out << (i == 0 ? "\n" : ",\n");
+        out << boost::format("    \"%1%\": %2%") % counter_name(static_cast<Counter>(i)) % counters[i].load();
+    }
+    out << "\n  },\n";
+    out << "  \"skipped_rows_by_reason\": {";
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        bool first = true;
+        for (const auto& [reason, rows] : skip_reasons) {
+            out << (first ? "\n    " : ",\n    ");
+            write_json_string(out, reason);
+            out << ": " << rows;
+            first = false;
+        }
+        if (!first)
+            out << "\n  ";
+    }
+    out << "}\n";
+    out << "}\n";
+}
+
+
+const char* stage_name(const Stage stage) noexcept {
+    for (const auto& [s, name] : STAGE_NAMES)
+        if (s == stage)
+            return name;
+    return "unknown";
+}
+
+
+const char* counter_name(const Counter counter) noexcept {
+    for (const auto& [c, name] : COUNTER_NAMES)
+        if (c == counter)
+            return name;
+    return "unknown";
+}
+
+
+StageTimer::StageTimer(
+            Metrics* metrics,
+            const Stage stage
+) noexcept:
+        metrics(metrics),
+        trace(active_trace()),
+        stage(stage),
+        start(metrics || trace ? Metrics::Clock::now() : Metrics::Clock::time_point())
+{}
+
+
+StageTimer::~StageTimer() {
+    stop();
+}
+
+
+void StageTimer::stop() noexcept {
+    if (!metrics && !trace)
+        return;
+    const auto now = Metrics::Clock::now();
+    if (metrics)
+        metrics->add_time(stage, now - start);
+    if (trace) {
+        try {
+            trace->add(stage_name(stage), start, now);
+        }
+        catch (...) {
+            // Out of memory for events; the trace misses this one
+        }
+    }
+    metrics = nullptr;
+    trace = nullptr;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "trace.hpp"
+
+
+/**
+ * \brief   Stages of a run, in the order they are reported.
+ */
+enum class Stage {
+    /// Opening the catalog, its column cache or a shared catalog and reading the header
+    open,
+    /// Reading (and decompressing) the file
+    read,
+    /// Finding rows and fields
+    tokenize,
+    /// Converting fields to stars, or reading them from the cache
+    parse,
+    /// Selecting the stars in the window
+    filter,
+    /// Finding the magnitude scale
+    minmax,
+    /// Mapping stars to pixels, and sorting them along a curve
+    project,
+    /// Plotting pixels
+    rasterize,
+    /// Compressing the image
+    encode,
+    /// Writing the image file
+    write,
+};
+
+
+/**
+ * \brief   Counts of a run.
+ */
+enum class Counter {
+    /// Catalog rows parsed, or stars read from the cache
+    rows,
+    /// Catalog bytes parsed, after decompression
+    bytes,
+    skipped_rows,
+    /// Stars in the window, and those of them that fell outside the image
+    stars_plotted,
+    stars_clipped,
+};
+
+
+/**
+ * \brief   Nanosecond timings of the stages of a run and its counters, for --metrics-json.
+ *
+ * Stages that run on several threads at once add up their time, so the
+ * stages of a pipelined read can exceed the wall time. Thread-safe.
+ */
+class Metrics {
+    public:
+        using Clock = TraceRecorder::Clock;
+
+        Metrics();
+
+        void add_time(
+                const Stage stage,
+                const Clock::duration duration,
+                const uint64_t spans = 1
+        ) noexcept;
+
+        void add_count(
+                const Counter counter,
+                const uint64_t value
+        ) noexcept;
+
+        /**
+         * \param   reason  error message the rows were skipped with
+         */
+        void add_skipped_rows(
+                const std::string& reason,
+                const uint64_t rows
+        );
+
+        /**
+         * \brief   Writes the stages, counters and skipped rows by reason as a JSON object.
+         *
+         * Every stage and counter is present, with zero if the run did not
+         * have it. Times are in nanoseconds; "wall_ns" runs from construction.
+         */
+        void write_json(std::ostream& out) const;
+
+    private:
+        static constexpr std::size_t STAGES = static_cast<std::size_t>(Stage::write) + 1;
+        static constexpr std::size_t COUNTERS = static_cast<std::size_t>(Counter::stars_clipped) + 1;
+
+        const Clock::time_point start;
+        std::array<std::atomic<int64_t>, STAGES> stage_ns{};
+        std::array<std::atomic<uint64_t>, STAGES> stage_spans{};
+        std::array<std::atomic<uint64_t>, COUNTERS> counters{};
+        mutable std::mutex mutex;
+        std::map<std::string, uint64_t> skip_reasons;
+};
+
+
+const char* stage_name(const Stage stage) noexcept;
+
+
+const char* counter_name(const Counter counter) noexcept;
+
+
+/**
+ * \brief   Adds the time from construction to stop() or destruction to a stage, and records it as a trace event.
+ *
+ * Does nothing without metrics and an active trace.
+ */
+class StageTimer {
+    public:
+        StageTimer(
+                    Metrics* metrics,
+                    const Stage stage
+        ) noexcept;
+
+        ~StageTimer();
+
+        StageTimer(const StageTimer&) = delete;
+        StageTimer& operator=(const StageTimer&) = delete;
+
+        void stop() noexcept;
+
+    private:
+        Metrics* metrics;
+        TraceRecorder* trace;
+        const Stage stage;
+        Metrics::Clock::time_point start;
+};
@@ -0,0 +1,524 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <boost/format.hpp>
+
+#include "async_reader.hpp"
+#include "bounded_queue.hpp"
+#include "compressed_input.hpp"
+#include "epoch.hpp"
+#include "trace.hpp"
+
+
+namespace {
+
+/**
+ * \brief   Whole rows of the catalog, as read from disk.
+ */
+struct Chunk {
+    std::size_t sequence = 0;
+    std::size_t first_row = 0;
+    std::string text;
+};
+
+
+struct SkippedRow {
+    std::size_t row;
+    std::string error;
+    std::string line;
+};
+
+
+/**
+ * \brief   Stars parsed from one chunk.
+ */
+struct Batch {
+    std::size_t sequence = 0;
+    StarColumns stars;
+    CatalogIds ids;
+    /// Enough skipped rows to reproduce the console report of a sequential read
+    std::vector<SkippedRow> skipped;
+    /// Rows skipped after those, and their errors
+    std::vector<std::pair<std::size_t, std::string>> unreported;
+    std::size_t rows = 0;
+    /// Rows dropped by the pushed-down filter, counting from the first row of the chunk
+    RowBitmap rejected;
+    PredicateCounters predicates;
+};
+
+
+/**
+ * \brief   First error raised by any stage, rethrown on the calling thread.
+ */
+class PipelineError {
+    public:
+        void set(std::exception_ptr error) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!first)
+                first = error;
+        }
+
+        void rethrow() {
+            if (first)
+                std::rethrow_exception(first);
+        }
+
+    private:
+        std::mutex mutex;
+        std::exception_ptr first;
+};
+
+
+/**
+ * \brief   Limits how far parsers run ahead of the batch the consumer is waiting for.
+ *
+ * The consumer holds batches that arrive out of order until the missing one
+ * is parsed. Without a limit, one slow chunk would let the other parsers
+ * fill memory with later batches, however small the queues.
+ */
+class ReorderWindow {
+    public:
+        explicit ReorderWindow(const std::size_t size):
+                size(size),
+                next(0),
+                unlimited(false)
+        {}
+
+        /**
+         * \brief   Waits until the chunk is less than the window size ahead of the consumer.
+         */
+        void enter(const std::size_t sequence) {
+            std::unique_lock<std::mutex> lock(mutex);
+            moved.wait(lock, [&] { return unlimited || sequence < next + size; });
+        }
+
+        /**
+         * \brief   Records that the consumer has taken every batch before next.
+         */
+        void advance(const std::size_t next) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (next == this->next)
+                    return;
+                this->next = next;
+            }
+            moved.notify_all();
+        }
+
+        /**
+         * \brief   Lets every parser through, once the consumer stops ordering batches.
+         */
+        void open() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                unlimited = true;
+            }
+            moved.notify_all();
+        }
+
+    private:
+        const std::size_t size;
+        std::size_t next;
+        bool unlimited;
+        std::mutex mutex;
+        std::condition_variable moved;
+};
+
+
+void read_chunks(
+        const std::string& path,
+        const Compression compression,
+        std::uint64_t header_bytes,
+        const PipelineOptions& options,
+        BoundedQueue<Chunk>& chunks,
+        Metrics* metrics
+) {
+    const auto start = Metrics::Clock::now();
+    Metrics::Clock::duration waiting{0};
+
+    AsyncReadOptions read_options;
+    read_options.backend = options.read_backend;
+    read_options.block_bytes = options.chunk_bytes;
+    read_options.depth = options.read_depth;
+
+    Chunk chunk;
+    std::size_t sequence = 0;
+    std::size_t first_row = 0;
+    const auto emit = [&] (Chunk& ready) {
+        ready.sequence = sequence++;
+        ready.first_row = first_row;
+        first_row += std::count(ready.text.cbegin(), ready.text.cend(), '\n');
+        if (metrics)
+            metrics->add_count(Counter::bytes, ready.text.size());
+        // Time spent waiting for the parsers is not reading
+        const TraceScope trace("wait for parsers");
+        const auto push_start = Metrics::Clock::now();
+        chunks.push(std::move(ready));
+        waiting += Metrics::Clock::now() - push_start;
+    };
+
+    const auto append = [&] (const char* data, std::size_t size) {
+        // The header of a compressed file is skipped here rather than seeked over
+        const auto skip = static_cast<std::size_t>(std::min<std::uint64_t>(header_bytes, size));
+        header_bytes -= skip;
+        chunk.text.append(data + skip, size - skip);
+        if (chunk.text.size() < options.chunk_bytes)
+            return;
+
+        // Hand over whole rows only; the tail goes into the next chunk
+        const auto last_newline = chunk.text.rfind('\n');
+        if (last_newline == std::string::npos)
+            return;
+        Chunk next;
+        next.text.reserve(options.chunk_bytes + read_options.block_bytes);
+        next.text.assign(chunk.text, last_newline + 1, std::string::npos);
+        chunk.text.resize(last_newline + 1);
+        emit(chunk);
+        chunk = std::move(next);
+    };
+
+    if (compression == Compression::none) {
+        const auto offset = header_bytes;
+        header_bytes = 0;
+        read_file_blocks(path, offset, read_options, append);
+    } else {
+        read_decompressed_blocks(path, compression, read_options, options.decompress_threads, append);
+    }
+    if (!chunk.text.empty())
+        emit(chunk);
+    if (metrics)
+        metrics->add_time(Stage::read, Metrics::Clock::now() - start - waiting);
+}
+
+
+void skip_row(
+        const std::size_t row,
+        const std::string& error,
+        const std::string_view line,
+        Batch& batch
+) {
+    if (batch.skipped.size() < SkippedRows::PRINTED_ROWS)
+        batch.skipped.push_back(SkippedRow{row, error, std::string(line)});
+    else
+        batch.unreported.emplace_back(row, error);
+}
+
+
+/**
+ * \brief   Splits the time of a parser thread between tokenizing and parsing, row by row; does nothing without metrics.
+ */
+class ParseTimer {
+    public:
+        explicit ParseTimer(Metrics* metrics) noexcept:
+                metrics(metrics),
+                last(metrics ? Metrics::Clock::now() : Metrics::Clock::time_point())
+        {}
+
+        /// Counts the time since the last call as tokenizing
+        void tokenized() noexcept {
+            lap(tokenize);
+        }
+
+        /// Counts the time since the last call as parsing
+        void parsed() noexcept {
+            lap(parse);
+        }
+
+        ~ParseTimer() {
+            if (!metrics)
+                return;
+            metrics->add_time(Stage::tokenize, tokenize);
+            metrics->add_time(Stage::parse, parse);
+        }
+
+    private:
+        void lap(Metrics::Clock::duration& stage) noexcept {
+            if (!metrics)
+                return;
+            const auto now = Metrics::Clock::now();
+            stage += now - last;
+            last = now;
+        }
+
+        Metrics* const metrics;
+        Metrics::Clock::time_point last;
+        Metrics::Clock::duration tokenize{0};
+        Metrics::Clock::duration parse{0};
+};
+
+
+/**
+ * \brief   Parses stars with the fixed_star_parser of the format, which splits each row only as far as it needs.
+ */
+void parse_fixed_chunk(
+        const Chunk& chunk,
+        const CatalogFormat& format,
+        ParseTimer& timer,
+        Batch& batch
+) {
+    std::size_t row = chunk.first_row;
+    const char* begin = chunk.text.data();
+    const char* const end = begin + chunk.text.size();
+    while (begin < end) {
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+        if (!newline)
+            newline = end;
+        std::string_view line(begin, newline - begin);
+        begin = newline + 1;
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        timer.tokenized();
+
+        try {
+            uint8_t sources;
+            const auto star = format.fixed_star_parser(line, format.delimiter, sources);
+            batch.stars.push_back(star.ra_deg, star.de_deg, star.mag, sources);
+        }
+        catch (const std::runtime_error& e) {
+            skip_row(row, e.what(), line, batch);
+        }
+        timer.parsed();
+        row++;
+    }
+    batch.rows = row - chunk.first_row;
+}
+
+
+/**
+ * \param   record  field index of the previous row, reused for the rows of this chunk
+ * \param   filter  if set, evaluated while parsing, see StarPredicateParser
+ * \param   metrics if set, receives the tokenize and parse times; the fixed-layout
+ *                  parsers split as they parse, so only finding rows counts as
+ *                  tokenizing for them
+ */
+void parse_chunk(
+        const Chunk& chunk,
+        const CatalogFormat& format,
+        const std::optional<double>& epoch,
+        const bool collect_ids,
+        const StarFilter* filter,
+        Record& record,
+        Batch& batch,
+        Metrics* metrics
+) {
+    batch.sequence = chunk.sequence;
+    ParseTimer timer(metrics);
+    if (format.fixed_star_parser && !epoch && !collect_ids && !filter) {
+        parse_fixed_chunk(chunk, format, timer, batch);
+        return;
+    }
+
+    std::optional<StarPredicateParser> predicates;
+    if (filter)
+        predicates.emplace(format, *filter);
+
+    MeanPositionColumns mean_positions;
+    std::size_t row = chunk.first_row;
+    split_records(
+        chunk.text,
+        format.delimiter,
+        record,
+        [&] (const Record& record, const std::string_view line) {
+            timer.tokenized();
+            if (collect_ids)
+                collect_catalog_ids(record, format, batch.ids);
+            try {
+                if (epoch) {
+                    parse_mean_position_record(record, format, mean_positions);
+                } else if (predicates) {
+                    uint8_t sources;
+                    const auto star = predicates->parse(record, &sources);
+                    if (star)
+                        batch.stars.push_back(star->ra_deg, star->de_deg, star->mag, sources);
+                    else
+                        batch.rejected.set(row - chunk.first_row);
+                } else {
+                    uint8_t sources;
+                    const auto star = parse_star_record(record, format, &sources);
+                    batch.stars.push_back(star.ra_deg, star.de_deg, star.mag, sources);
+                }
+            }
+            catch (const std::runtime_error& e) {
+                skip_row(row, e.what(), line, batch);
+            }
+            timer.parsed();
+            row++;
+        }
+    );
+    timer.tokenized();
+    batch.rows = row - chunk.first_row;
+    if (predicates)
+        batch.predicates = predicates->counters();
+
+    if (epoch)
+        propagate_epoch(mean_positions, format.astrometry.value().epoch, *epoch, batch.stars);
+    timer.parsed();
+}
+
+}
+
+
+std::size_t pipeline_star_blocks(
+        const std::string& path,
+        const CatalogFormat& format,
+        const std::optional<double>& epoch,
+        const PipelineOptions& options,
+        const std::function<void(const StarColumns&)>& consume,
+        CatalogIds* ids,
+        RowBitmap* skipped,
+        FilterPushdown* pushdown,
+        Metrics* metrics
+) {
+    StageTimer open_timer(metrics, Stage::open);
+    const auto compression = detect_compression(path);
+
+    CatalogFormat resolved = format;
+    std::uint64_t header_bytes = 0;
+    if (format.header) {
+        const auto file = open_catalog_stream(path);
+        std::string header;
+        if (!std::getline(*file, header))
+            throw std::runtime_error(
+                (
+                    boost::format("Missing header line in %1%") % path
+                ).str()
+            );
+        header_bytes = header.size() + 1;
+        if (!header.empty() && header.back() == '\r')
+            header.pop_back();
+        resolved = resolve_format(format, header);
+    }
+    if (epoch && !resolved.astrometry)
+        throw std::runtime_error(
+            (
+                boost::format("Catalog %1% has no proper motions for epoch propagation") % path
+            ).str()
+        );
+    if (epoch && pushdown)
+        throw std::runtime_error("A filter can not be pushed down into parsing with epoch propagation");
+    const StarFilter* const filter = pushdown ? &pushdown->filter : nullptr;
+    if (pushdown) {
+        pushdown->rejected_rows = RowBitmap();
+        pushdown->counters = PredicateCounters();
+    }
+    open_timer.stop();
+
+    const std::size_t parser_threads = options.parser_threads != 0
+        ? options.parser_threads
+        : std::max(1u, std::thread::hardware_concurrency());
+
+    BoundedQueue<Chunk> chunks(options.queue_depth);
+    BoundedQueue<Batch> batches(options.queue_depth, parser_threads);
+    // No more batches wait for reordering than the queues hold
+    ReorderWindow window(options.queue_depth + parser_threads);
+    PipelineError error;
+
+    std::thread reader(
+        [&] {
+            name_trace_thread("reader");
+            const TraceScope trace("read");
+            try {
+                read_chunks(path, compression, header_bytes, options, chunks, metrics);
+            }
+            catch (...) {
+                error.set(std::current_exception());
+            }
+            chunks.close();
+        }
+    );
+
+    std::vector<std::thread> parsers;
+    for (std::size_t i = 0; i < parser_threads; i++)
+        parsers.emplace_back(
+            [&, i] {
+                name_trace_thread((boost::format("parser %1%") % i).str());
+                ParseArena arena;
+                Record record(&arena);
+                Chunk chunk;
+                while (chunks.pop(chunk)) {
+                    {
+                        const TraceScope trace("wait for reorder window");
+                        window.enter(chunk.sequence);
+                    }
+                    Batch batch;
+                    try {
+                        const TraceScope trace("parse chunk");
+                        parse_chunk(chunk, resolved, epoch, ids != nullptr, filter, record, batch, metrics);
+                    }
+                    catch (...) {
+                        error.set(std::current_exception());
+                        // An empty batch still moves the consumer, and so the window, past the chunk
+                        batch = Batch();
+                        batch.sequence = chunk.sequence;
+                    }
+                    const TraceScope trace("wait for consumer");
+                    batches.push(std::move(batch));
+                }
+                batches.close();
+            }
+        );
+
+    // Consume on this thread, restoring file order
+    SkippedRows skipped_rows;
+    std::map<std::size_t, Batch> pending;
+    std::size_t next_sequence = 0;
+    std::size_t rows = 0;
+    Batch batch;
+    try {
+        while (batches.pop(batch)) {
+            pending.emplace(batch.sequence, std::move(batch));
+            for (auto it = pending.find(next_sequence); it != pending.end(); it = pending.find(++next_sequence)) {
+                auto& ready = it->second;
+                for (const auto& row : ready.skipped)
+                    skipped_rows.report(row.row, row.error, row.line);
+                for (const auto& [row, error] : ready.unreported)
+                    skipped_rows.add_unreported(row, error);
+                if (pushdown) {
+                    for (std::size_t i = 0; i < ready.rejected.size(); i++)
+                        if (ready.rejected.test(i))
+                            pushdown->rejected_rows.set(rows + i);
+                    pushdown->counters.add(ready.predicates);
+                }
+                rows += ready.rows;
+                if (ids) {
+                    ids->tyc.insert(ready.ids.tyc.cbegin(), ready.ids.tyc.cend());
+                    ids->hip.insert(ready.ids.hip.cbegin(), ready.ids.hip.cend());
+                }
+                if (ready.stars.size() != 0)
+                    consume(ready.stars);
+                pending.erase(it);
+            }
+            window.advance(next_sequence);
+        }
+    }
+    catch (...) {
+        error.set(std::current_exception());
+        window.open();
+        // Keep draining, so that no stage blocks on a full queue
+        while (batches.pop(batch)) {}
+    }
+
+    reader.join();
+    for (auto& parser : parsers)
+        parser.join();
+    error.rethrow();
+
+    if (skipped) {
+        *skipped = skipped_rows.rows();
+        skipped->resize(rows);
+    }
+    if (pushdown)
+        pushdown->rejected_rows.resize(rows);
+    if (metrics) {
+        metrics->add_count(Counter::rows, rows);
+        for (const auto& [reason, count] : skipped_rows.reasons())
+            metrics->add_skipped_rows(reason, count);
+    }
+    return skipped_rows.count();
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+
+#include "async_reader.hpp"
+#include "catalog.hpp"
+#include "metrics.hpp"
+#include "star_columns.hpp"
+
+
+/**
+ * \brief   Sizing of the read/parse pipeline.
+ */
+struct PipelineOptions {
+    /// Parser threads; zero means one per hardware thread
+    std::size_t parser_threads = 0;
+    /// Bytes per chunk handed from the reader thread to the parsers
+    std::size_t chunk_bytes = 4 << 20;
+    /// Chunks and batches in flight between stages
+    std::size_t queue_depth = 16;
+    /// How the I/O thread reads the file
+    ReadBackend read_backend = ReadBackend::automatic;
+    /// Reads the I/O thread keeps in flight
+    std::size_t read_depth = 8;
+    /// Threads decompressing multi-frame zstd input; zero means one per hardware thread
+    std::size_t decompress_threads = 0;
+};
+
+
+/**
+ * \brief   Filter evaluated while parsing, and what it rejected.
+ *
+ * \see     StarPredicateParser
+ */
+struct FilterPushdown {
+    StarFilter filter;
+    /// One bit per data row, set for the rows the filter dropped
+    RowBitmap rejected_rows;
+    PredicateCounters counters;
+};
+
+
+/**
+ * \brief   Reads and parses a catalog on a staged pipeline, delivering star blocks in file order.
+ *
+ * An I/O thread reads the file with several large reads in flight (see
+ * read_file_blocks()), decompressing gzip and zstd input on the way (see
+ * read_decompressed_blocks()), and cuts it into chunks at row boundaries, parser
+ * threads turn chunks into star blocks (propagated to the epoch, if one is
+ * given), and the calling thread consumes the blocks while the other stages
+ * keep running. Stages are connected by bounded lock-free queues, so the wall
+ * time approaches that of the slowest stage. Blocks are delivered in file
+ * order, so the result is identical to a sequential read.
+ *
+ * \param   consume     called on the calling thread for every block
+ * \param   ids         if set, receives the TYC/HIP identifiers of every row
+ * \param   skipped     if set, receives one bit per data row, set for the skipped rows
+ * \param   pushdown    if set, stars its filter rejects are dropped while parsing; not
+ *                      possible with an epoch, which moves the stars after parsing
+ * \param   metrics     if set, receives the open, read, tokenize and parse times, the
+ *                      rows, bytes and skipped rows by reason; splitting and parsing
+ *                      are then timed row by row, and a pushed-down filter counts as
+ *                      parsing
+ * \return  number of skipped rows
+ */
+std::size_t pipeline_star_blocks(
+        const std::string& path,
+        const CatalogFormat& format,
+        const std::optional<double>& epoch,
+        const PipelineOptions& options,
+        const std::function<void(const StarColumns&)>& consume,
+        CatalogIds* ids = nullptr,
+        RowBitmap* skipped = nullptr,
+        FilterPushdown* pushdown = nullptr,
+        Metrics* metrics = nullptr
+);
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+#include "delimiter_scanner.hpp"
+
+
+/**
+ * \brief   A column of a fixed-layout catalog, at a position known at compile time.
+ *
+ * \tparam  Type        value of the column; parsers generated from a schema convert the field by it
+ * \tparam  Nullable    blank values are expected and read as missing rather than as errors
+ */
+template<std::size_t Index, typename Type, bool Nullable = false>
+struct SchemaField {
+    static constexpr std::size_t index = Index;
+    using type = Type;
+    static constexpr bool nullable = Nullable;
+};
+
+
+/**
+ * \brief   The fields of one row that a parse needs, as given by a schema of SchemaField columns.
+ *
+ * The row is split only up to the last column of the schema, and the other
+ * columns are stepped over without being kept, so columns that are not in
+ * the schema cost nothing but the scan for their delimiters. The column to
+ * slot mapping is computed at compile time.
+ */
+template<typename... Fields>
+class SchemaRecord {
+    public:
+        /// Columns up to and including the last one in the schema
+        static constexpr std::size_t columns = std::max({Fields::index...}) + 1;
+
+        /**
+         * \brief   Finds the schema fields of a row.
+         *
+         * \param   line    row text without the line end; must outlive the fields
+         */
+        void split(
+                const std::string_view line,
+                const char delimiter
+        ) noexcept {
+            DelimiterScanner scanner(line, delimiter);
+            std::size_t begin = 0;
+            present = 0;
+            while (present < columns) {
+                auto end = scanner.next();
+                while (end < line.size() && line[end] != delimiter)
+                    end = scanner.next();
+
+                if (SLOTS[present] >= 0)
+                    fields[SLOTS[present]] = line.substr(begin, end - begin);
+                present++;
+                if (end >= line.size())
+                    break;
+                begin = end + 1;
+            }
+        }
+
+        /**
+         * \return  nothing if the row ends before the column
+         */
+        template<typename Field>
+        std::optional<std::string_view> field() const noexcept {
+            static_assert(SLOTS[Field::index] >= 0, "Field is not in the schema");
+            if (Field::index >= present)
+                return std::nullopt;
+            return fields[SLOTS[Field::index]];
+        }
+
+    private:
+        static constexpr std::array<int, columns> make_slots() {
+            std::array<int, columns> slots{};
+            for (auto& slot : slots)
+                slot = -1;
+            const std::size_t indices[] = {Fields::index...};
+            for (std::size_t i = 0; i < sizeof...(Fields); i++)
+                slots[indices[i]] = static_cast<int>(i);
+            return slots;
+        }
+
+        /// Slot of every column up to the last one, -1 for columns outside the schema
+        static constexpr std::array<int, columns> SLOTS = make_slots();
+
+        std::array<std::string_view, sizeof...(Fields)> fields;
+        /// Columns found in the row, at most columns
+        std::size_t present = 0;
+};
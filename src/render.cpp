@@ -2,13 +2,26 @@
 #include <fstream>
 #include <iostream>
 #include <optional>
-#include <boost/algorithm/string/classification.hpp>
-#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/join.hpp>
 #include <boost/format.hpp>
 #include <boost/program_options.hpp>
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgcodecs.hpp>
 
+#include "apparent.hpp"
+#include "catalog.hpp"
+#include "curve_order.hpp"
+#include "epoch.hpp"
+#include "image_output.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "pipeline.hpp"
+#include "star.hpp"
+#include "star_render.hpp"
+#include "star_source.hpp"
+#include "starfinder.hpp"
+#include "trace.hpp"
+
 
 namespace po = boost::program_options;
 
@@ -24,158 +37,31 @@ constexpr char OPT_MAX_MAGNITUDE[] = "max-magnitude";
 constexpr char OPT_WIDTH[] = "width";
 constexpr char OPT_HEIGHT[] = "height";
 constexpr char OPT_OUTPUT[] = "output";
-
-
-/**
- * \brief   Represents a star with its right ascension, declination, and magnitude.
- */
-struct Star {
-    const double ra_deg;
-    const double de_deg;
-    const double mag;
-
-    Star(
-                const double ra_deg,
-                const double de_deg,
-                const double mag
-    ) noexcept:
-            ra_deg(ra_deg),
-            de_deg(de_deg),
-            mag(mag)
-    {}
-};
-
-
-std::optional<double> parse_field(
-        const std::vector<std::string>& record,
-        const size_t index,
-        const std::string& field_name
-) {
-    double value;
-
-    try {
-        value = std::stod(record.at(index));
-    }
-    catch (const std::out_of_range&) {
-        throw std::runtime_error(
-            (
-                boost::format("Missing field: %1%") % field_name
-            ).str()
-        );
-    }
-    catch (const std::invalid_argument& e) {
-        throw std::runtime_error(
-            (
-                boost::format("Failed to parse %1%. %2%") % field_name % e.what()
-            ).str()
-        );
-    }
-    
-    return value;
-}
-
-
-double parse_magnitude(const std::vector<std::string>& record) {
-    std::optional<double> bt_mag, vt_mag;
-    try {
-        bt_mag = parse_field(record, 17, "BT magnitude");
-        vt_mag = parse_field(record, 19, "VT magnitude");
-    }
-    catch (const std::runtime_error&) {};
-
-    if (bt_mag) {
-        const auto bt = bt_mag.value();
-        if (vt_mag) {
-            const auto vt = vt_mag.value();
-            const auto v_mag = vt - 0.090 * (bt - vt);
-            // std::cout << boost::format("Debug: Calculated V_Mag = %1$.3f") % v_mag << std::endl;
-            return v_mag;
-        } else {
-            // std::cout << boost::format("Debug: Using BT_Mag as V_Mag = %1$.3f") % bt << std::endl;
-            return bt;
-        }
-    } else {
-        if (vt_mag) {
-            const auto vt = vt_mag.value();
-            // std::cout << boost::format("Debug: Using VT_Mag as V_Mag = %1$.3f") % vt << std::endl;
-            return vt;
-        } else {
-            throw std::runtime_error("Missing magnitude");
-        }
-    }
-}
-
-
-Star parse_star_record(const std::vector<std::string>& record) {
-    const auto ra = parse_field(record, 24, "RA");
-    const auto dec = parse_field(record, 25, "Dec");
-    const auto mag = parse_magnitude(record);
-
-    return Star(
-        ra.value(),
-        dec.value(),
-        mag
-    );
-}
-
-
-std::vector<Star> read_stars(
-        const std::string& path,
-        const double min_ra,
-        const double max_ra,
-        const double min_dec,
-        const double max_dec,
-        const double max_magnitude
-) {
-    std::vector<Star> stars;
-    std::size_t skipped_rows = 0;
-    {
-        std::ifstream file(path);
-        std::size_t i = 0;
-        for (std::string line; std::getline(file, line);) {
-            std::vector<std::string> record;
-            record.reserve(35);
-            boost::split(
-                record,
-                line,
-                boost::is_any_of("|")
-            );
-            try {
-                const auto star = parse_star_record(record);
-                if (
-                        star.ra_deg >= min_ra
-                        &&
-                        star.ra_deg <= max_ra
-                        &&
-                        star.de_deg >= min_dec
-                        &&
-                        star.de_deg <= max_dec
-                        &&
-                        star.mag <= max_magnitude
-                ) {
-                    if ((i % 10000) == 0)
-                        std::cout << boost::format("Star %1%: RA=%2%, Dec=%3%, Mag=%4%") % i % star.ra_deg % star.de_deg % star.mag << std::endl;
-                    
-                    stars.push_back(star);
-                }
-            }
-            catch (const std::runtime_error& e) {
-                skipped_rows++;
-                if (skipped_rows <= 10) {
-                    std::cerr << boost::format("Skipping row %1% due to error: %2%") % i % e.what() << std::endl;
-                    std::cerr << boost::format("Problematic row: %1%") % line << std::endl;
-                } else if (skipped_rows == 11) {
-                    std::cerr << "Further skipped rows will not be printed..." << std::endl;
-                }
-            }
-        }
-    }
-
-    std::cout << "Total stars read and filtered: " << stars.size() << std::endl;
-    std::cout << "Total rows skipped: " << skipped_rows << std::endl;
-
-    return stars;
-};
+constexpr char OPT_EPOCH[] = "epoch";
+constexpr char OPT_CACHE_DIR[] = "cache-dir";
+constexpr char OPT_NO_CACHE[] = "no-cache";
+constexpr char OPT_CACHE_DEC_BANDS[] = "cache-dec-bands";
+constexpr char OPT_APPARENT[] = "apparent";
+constexpr char OPT_OBSERVER_LAT[] = "observer-lat";
+constexpr char OPT_OBSERVER_LON[] = "observer-lon";
+constexpr char OPT_SUPPLEMENT[] = "supplement";
+constexpr char OPT_FORMAT[] = "format";
+constexpr char OPT_STREAM[] = "stream";
+constexpr char OPT_MIN_MAGNITUDE[] = "min-magnitude";
+constexpr char OPT_THREADS[] = "threads";
+constexpr char OPT_READER[] = "reader";
+constexpr char OPT_STAR_ORDER[] = "star-order";
+constexpr char OPT_METRICS_JSON[] = "metrics-json";
+constexpr char OPT_TRACE[] = "trace";
+constexpr char OPT_QUIET[] = "quiet";
+constexpr char OPT_PROGRESS[] = "progress";
+constexpr char OPT_IMAGE_FORMAT[] = "image-format";
+constexpr char OPT_PNG_LEVEL[] = "png-level";
+constexpr char OPT_PNG_STRATEGY[] = "png-strategy";
+constexpr char OPT_ENCODE_THREADS[] = "encode-threads";
+constexpr char OPT_DEPTH[] = "depth";
+constexpr char OPT_SHARED[] = "shared";
+constexpr char OPT_PUBLISH_SHARED[] = "publish-shared";
 
 
 template <class Clock>
@@ -203,58 +89,54 @@ float Stopwatch<Clock>::elapsed() const {
 }
 
 
-void render_stars(
-        const std::vector<Star>& stars,
-        const uint32_t width,
-        const uint32_t height,
-        const double min_ra,
-        const double max_ra,
-        const double min_dec,
-        const double max_dec,
-        cv::OutputArray dst
+/**
+ * \brief   Writes the metrics of the run to the file given with --metrics-json.
+ */
+void write_metrics(
+        const std::optional<Metrics>& metrics,
+        const po::variables_map& vm
 ) {
-    dst.create(height, width, CV_8UC1);
-    cv::Mat img = dst.getMat();
-
-    // Find the minimum and maximum magnitudes in the dataset
-    const auto [min_mag_star, max_mag_star] = std::minmax_element(
-        stars.cbegin(),
-        stars.cend(),
-        [] (const Star& a, const Star& b) {
-            return (a.mag < b.mag);
-        }
-    );
-    const auto min_mag = min_mag_star->mag;
-    const auto max_mag = max_mag_star->mag;
-
-    std::cout << boost::format("Magnitude range: %1$.3f to %2$.3f") % min_mag % max_mag << std::endl;
-
-    const auto ra_range = max_ra - min_ra;
-    const auto dec_range = max_dec - min_dec;
-    const auto mag_range = max_mag - min_mag;
-    for (const Star& star : stars) {
-        const uint32_t x = (star.ra_deg - min_ra) / ra_range * width;
-        const uint32_t y = (star.de_deg - min_dec) / dec_range * height;
-
-        if (x < width && y < height) {
-            // Inverse the magnitude scale (brighter stars have lower magnitudes)
-            const auto normalized_mag = (max_mag - star.mag) / mag_range;
-
-            // Apply a non-linear scaling to emphasize brighter stars
-            const uint8_t brightness = std::pow(normalized_mag, 2.5) * 255;
-
-            cv::circle(
-                img,
-                cv::Point(x, y),
-                0,
-                cv::Scalar(brightness)
-            );
-        }
-    }
+    if (!metrics)
+        return;
+
+    const auto& path = vm[OPT_METRICS_JSON].as<std::string>();
+    std::ofstream file(path);
+    metrics->write_json(file);
+    if (!file)
+        throw std::runtime_error(
+            (
+                boost::format("Failed to write metrics %1%") % path
+            ).str()
+        );
+    log_info("Metrics saved as: %1%", path);
 }
 
 
-int main(int argc, char** argv) {
+/**
+ * \brief   Stops tracing and writes the trace to the file given with --trace.
+ */
+void write_trace(
+        const std::optional<TraceRecorder>& trace,
+        const po::variables_map& vm
+) {
+    if (!trace)
+        return;
+
+    set_active_trace(nullptr);
+    const auto& path = vm[OPT_TRACE].as<std::string>();
+    std::ofstream file(path);
+    trace->write_json(file);
+    if (!file)
+        throw std::runtime_error(
+            (
+                boost::format("Failed to write trace %1%") % path
+            ).str()
+        );
+    log_info("Trace saved as: %1%", path);
+}
+
+
+int run(int argc, char** argv) {
     po::variables_map vm;
     {
         po::options_description general_options("General options");
@@ -263,6 +145,24 @@ int main(int argc, char** argv) {
             (OPT_WIDTH, po::value<uint32_t>()->default_value(800), "Output image width in pixels")
             (OPT_HEIGHT, po::value<uint32_t>()->default_value(600), "Output image height in pixels")
             (OPT_OUTPUT, po::value<std::string>()->default_value("star_map.png"), "Output image file name")
+            (OPT_DEPTH, po::value<std::string>()->default_value("8"), ("Pixel depth of the image: " + boost::algorithm::join(pixel_depth_names(), ", ") + " (16-bit and float keep stars fainter than 1/255 of full brightness)").c_str())
+            (OPT_IMAGE_FORMAT, po::value<std::string>()->default_value("auto"), ("Output image format: " + boost::algorithm::join(image_format_names(), ", ") + " (auto goes by the file name extension)").c_str())
+            (OPT_PNG_LEVEL, po::value<int>()->default_value(1), "PNG compression level, 0 (fastest) to 9 (smallest)")
+            (OPT_PNG_STRATEGY, po::value<std::string>()->default_value("rle"), ("PNG compression strategy: " + boost::algorithm::join(png_strategy_names(), ", ")).c_str())
+            (OPT_ENCODE_THREADS, po::value<uint32_t>()->default_value(0), "Threads compressing PNG row strips (0 for one per CPU)")
+            (OPT_STAR_ORDER, po::value<std::string>()->default_value("catalog"), ("Order stars are plotted in, for large images: " + boost::algorithm::join(star_order_names(), ", ") + " (not with --stream)").c_str())
+            (OPT_STREAM, "render stars as they are read, in constant memory")
+            (OPT_THREADS, po::value<uint32_t>()->default_value(0), "Parser threads (0 for one per CPU)")
+            (OPT_READER, po::value<std::string>()->default_value("auto"), ("How the catalog is read: " + boost::algorithm::join(read_backend_names(), ", ")).c_str())
+            (OPT_CACHE_DIR, po::value<std::string>()->default_value(""), "Directory for cache files (empty for next to the catalog)")
+            (OPT_NO_CACHE, "do not read or write cache files")
+            (OPT_CACHE_DEC_BANDS, po::value<uint32_t>()->default_value(0), "Sort cache rows into this many declination bands, so narrow Dec ranges read less of the cache (0 keeps catalog order; only with --epoch, --stream or --publish-shared)")
+            (OPT_PUBLISH_SHARED, po::value<std::string>(), "Load the catalog into this shared memory segment for --shared and exit (a name, or a file path e.g. on a hugetlbfs mount)")
+            (OPT_SHARED, po::value<std::string>(), "Render from the catalog published in this shared memory segment instead of reading it (takes its epoch and apparent places)")
+            (OPT_METRICS_JSON, po::value<std::string>(), "Write stage timings (in nanoseconds) and counters to this JSON file")
+            (OPT_QUIET, "print errors only")
+            (OPT_PROGRESS, po::value<std::size_t>()->default_value(10000), "Print a star every this many catalog rows while reading (0 for none)")
+            (OPT_TRACE, po::value<std::string>(), (std::string("Write a Chrome trace of the stages and threads to this JSON file") + (TRACING_COMPILED ? "" : " (not compiled in)")).c_str())
         ;
 
         po::options_description filter_options("Filter options");
@@ -273,11 +173,18 @@ int main(int argc, char** argv) {
             (OPT_MIN_DEC, po::value<double>()->default_value(-90), "Minimum Declination (degrees)")
             (OPT_MAX_DEC, po::value<double>()->default_value(90), "Maximum Declination (degrees)")
             (OPT_MAX_MAGNITUDE, po::value<double>()->default_value(6), "Maximum visual magnitude (lower is brighter)")
+            (OPT_MIN_MAGNITUDE, po::value<double>(), "Magnitude rendered at full brightness (default: brightest star in the window)")
+            (OPT_EPOCH, po::value<double>(), "Propagate mean positions to this epoch (Julian years, e.g. 2025.5)")
+            (OPT_APPARENT, "render apparent places for the epoch (requires --epoch)")
+            (OPT_OBSERVER_LAT, po::value<double>(), "Observer latitude for diurnal aberration (degrees)")
+            (OPT_OBSERVER_LON, po::value<double>(), "Observer east longitude for diurnal aberration (degrees)")
         ;
 
         po::options_description arguments("Arguments");
         arguments.add_options()
-            (OPT_FILE, po::value<std::string>()->default_value("data/tycho2/catalog.dat"), "Path to the Tycho-2 catalog file")
+            (OPT_FILE, po::value<std::string>()->default_value("data/tycho2/catalog.dat"), "Path to the catalog file")
+            (OPT_FORMAT, po::value<std::string>()->default_value("tycho2"), ("Catalog format: " + boost::algorithm::join(catalog_format_names(), ", ")).c_str())
+            (OPT_SUPPLEMENT, po::value<std::vector<std::string>>()->multitoken()->composing(), "Tycho-2 supplement files to merge (suppl_1.dat, suppl_2.dat)")
         ;
 
         po::positional_options_description arguments_positions;
@@ -304,56 +211,259 @@ int main(int argc, char** argv) {
     }
 
 
-    std::cout << boost::format("Reading stars from: %1%") % vm[OPT_FILE].as<std::string>() << std::endl;
-    std::cout << boost::format("RA range: %1% to %2%") % vm[OPT_MIN_RA].as<double>() % vm[OPT_MAX_RA].as<double>() << std::endl;
-    std::cout << boost::format("Dec range: %1% to %2%") % vm[OPT_MIN_DEC].as<double>() % vm[OPT_MAX_DEC].as<double>() << std::endl;
-    std::cout << boost::format("Max magnitude: %1%") % vm[OPT_MAX_MAGNITUDE].as<double>() << std::endl;
+    if (vm.count(OPT_QUIET) != 0)
+        set_log_level(LogLevel::error);
+    set_progress_interval(vm[OPT_PROGRESS].as<std::size_t>());
 
-    const Stopwatch<std::chrono::high_resolution_clock> read_start;
-    const auto stars = read_stars(
-        vm[OPT_FILE].as<std::string>(),
+    std::optional<Metrics> metrics;
+    if (vm.count(OPT_METRICS_JSON) != 0)
+        metrics.emplace();
+    Metrics* const metrics_ptr = metrics ? &*metrics : nullptr;
+
+    std::optional<TraceRecorder> trace;
+    if (vm.count(OPT_TRACE) != 0) {
+        if (!TRACING_COMPILED) {
+            log_error("--%1% requires a build with -DSTARFINDER_TRACING=ON", OPT_TRACE);
+            return -1;
+        }
+        trace.emplace();
+        set_active_trace(&*trace);
+        name_trace_thread("main");
+    }
+
+    const bool shared = vm.count(OPT_SHARED) != 0;
+    if (shared)
+        log_info("Reading stars from shared catalog: %1%", vm[OPT_SHARED].as<std::string>());
+    else
+        log_info("Reading stars from: %1%", vm[OPT_FILE].as<std::string>());
+    log_info("Catalog format: %1%", vm[OPT_FORMAT].as<std::string>());
+    log_info("RA range: %1% to %2%", vm[OPT_MIN_RA].as<double>(), vm[OPT_MAX_RA].as<double>());
+    log_info("Dec range: %1% to %2%", vm[OPT_MIN_DEC].as<double>(), vm[OPT_MAX_DEC].as<double>());
+    log_info("Max magnitude: %1%", vm[OPT_MAX_MAGNITUDE].as<double>());
+
+    if (vm.count(OPT_APPARENT) != 0 && vm.count(OPT_EPOCH) == 0) {
+        log_error("--%1% requires --%2%", OPT_APPARENT, OPT_EPOCH);
+        return -1;
+    }
+
+    if (shared && (vm.count(OPT_EPOCH) != 0 || vm.count(OPT_STREAM) != 0 || vm.count(OPT_PUBLISH_SHARED) != 0)) {
+        log_error("--%1% can not be combined with --%2%, --%3% or --%4%", OPT_SHARED, OPT_EPOCH, OPT_STREAM, OPT_PUBLISH_SHARED);
+        return -1;
+    }
+
+    if (vm.count(OPT_PUBLISH_SHARED) != 0 && vm.count(OPT_STREAM) != 0) {
+        log_error("--%1% can not be combined with --%2%", OPT_PUBLISH_SHARED, OPT_STREAM);
+        return -1;
+    }
+
+    if (vm.count(OPT_EPOCH) != 0)
+        log_info("Epoch: J%1%", vm[OPT_EPOCH].as<double>());
+
+    std::vector<std::string> supplement_paths;
+    if (vm.count(OPT_SUPPLEMENT) != 0) {
+        supplement_paths = vm[OPT_SUPPLEMENT].as<std::vector<std::string>>();
+        for (const auto& supplement : supplement_paths)
+            log_info("Merging supplement: %1%", supplement);
+    }
+
+    // Fails early on unknown formats
+    catalog_format(vm[OPT_FORMAT].as<std::string>());
+    const StarFilter filter{
         vm[OPT_MIN_RA].as<double>(),
         vm[OPT_MAX_RA].as<double>(),
         vm[OPT_MIN_DEC].as<double>(),
         vm[OPT_MAX_DEC].as<double>(),
         vm[OPT_MAX_MAGNITUDE].as<double>()
-    );
+    };
+
+    std::optional<double> epoch;
+    if (vm.count(OPT_EPOCH) != 0)
+        epoch = vm[OPT_EPOCH].as<double>();
+
+    std::optional<ApparentTransform> apparent;
+    if (vm.count(OPT_APPARENT) != 0) {
+        std::optional<Observer> observer;
+        if (vm.count(OPT_OBSERVER_LAT) != 0 && vm.count(OPT_OBSERVER_LON) != 0)
+            observer = Observer{vm[OPT_OBSERVER_LAT].as<double>(), vm[OPT_OBSERVER_LON].as<double>()};
+        apparent = make_apparent_transform(julian_epoch_to_jd(epoch.value()), observer);
+    }
+
+    std::optional<double> min_magnitude;
+    if (vm.count(OPT_MIN_MAGNITUDE) != 0)
+        min_magnitude = vm[OPT_MIN_MAGNITUDE].as<double>();
+
+    const auto order = star_order(vm[OPT_STAR_ORDER].as<std::string>());
+
+    const auto depth = pixel_depth(vm[OPT_DEPTH].as<std::string>());
+
+    ImageOptions image_options;
+    image_options.format = image_format(vm[OPT_IMAGE_FORMAT].as<std::string>());
+    image_options.png_level = vm[OPT_PNG_LEVEL].as<int>();
+    image_options.png_strategy = png_strategy(vm[OPT_PNG_STRATEGY].as<std::string>());
+    image_options.threads = vm[OPT_ENCODE_THREADS].as<uint32_t>();
+    image_options.window = SkyWindow{
+        vm[OPT_MIN_RA].as<double>(),
+        vm[OPT_MAX_RA].as<double>(),
+        vm[OPT_MIN_DEC].as<double>(),
+        vm[OPT_MAX_DEC].as<double>(),
+        epoch
+    };
+
+    CatalogOptions catalog_options;
+    catalog_options.path = vm[OPT_FILE].as<std::string>();
+    catalog_options.format = vm[OPT_FORMAT].as<std::string>();
+    catalog_options.supplement_paths = supplement_paths;
+    catalog_options.epoch = epoch;
+    if (vm.count(OPT_NO_CACHE) != 0)
+        catalog_options.cache_dir.reset();
+    else
+        catalog_options.cache_dir = vm[OPT_CACHE_DIR].as<std::string>();
+    // Row numbers of the catalog report are recovered from a cache in catalog order
+    const bool catalog_report = vm.count(OPT_STREAM) == 0 && !epoch && vm.count(OPT_PUBLISH_SHARED) == 0;
+    catalog_options.cache_dec_bands = catalog_report ? 0 : vm[OPT_CACHE_DEC_BANDS].as<uint32_t>();
+    if (catalog_report && !vm[OPT_CACHE_DEC_BANDS].defaulted() && vm[OPT_CACHE_DEC_BANDS].as<uint32_t>() != 0)
+        log_info("--%1% is ignored without --%2%, --%3% or --%4%; the cache keeps catalog order", OPT_CACHE_DEC_BANDS, OPT_EPOCH, OPT_STREAM, OPT_PUBLISH_SHARED);
+    catalog_options.pipeline.parser_threads = vm[OPT_THREADS].as<uint32_t>();
+    catalog_options.pipeline.read_backend = read_backend(vm[OPT_READER].as<std::string>());
+
+    if (vm.count(OPT_PUBLISH_SHARED) != 0) {
+        const auto& name = vm[OPT_PUBLISH_SHARED].as<std::string>();
+        const Stopwatch<std::chrono::high_resolution_clock> publish_start;
+        auto catalog = StarCatalog::load(catalog_options, nullptr, metrics_ptr);
+        if (apparent) {
+            const Stopwatch<std::chrono::high_resolution_clock> apparent_start;
+            catalog.apply_apparent_place(*apparent);
+            log_info("Time taken to compute apparent places: %1%", apparent_start.elapsed());
+        }
+        catalog.publish(name);
+
+        log_info("Stars published: %1%", catalog.size());
+        log_info("Shared catalog published as: %1%", name);
+        log_info("Total time elapsed: %1%", publish_start.elapsed());
+        write_metrics(metrics, vm);
+        write_trace(trace, vm);
+        return 0;
+    }
+
+    if (vm.count(OPT_STREAM) != 0) {
+        StarBlockSource source(catalog_options, metrics_ptr);
+        // Only applies to uncached parses at the catalog epoch
+        source.push_down(filter);
+        const Stopwatch<std::chrono::high_resolution_clock> stream_start;
+        cv::Mat img;
+        stream_render(
+            source,
+            filter,
+            apparent,
+            min_magnitude,
+            vm[OPT_DISPLAY_COUNT].as<uint32_t>(),
+            vm[OPT_WIDTH].as<uint32_t>(),
+            vm[OPT_HEIGHT].as<uint32_t>(),
+            depth,
+            img,
+            metrics_ptr
+        );
+        const Stopwatch<std::chrono::high_resolution_clock> save_start;
+        write_image(vm[OPT_OUTPUT].as<std::string>(), img, image_options, metrics_ptr);
+        log_info("Time taken to encode and save image: %1%", save_start.elapsed());
+
+        log_info("Image saved as: %1%", vm[OPT_OUTPUT].as<std::string>());
+        log_info("Total time elapsed: %1%", stream_start.elapsed());
+        write_metrics(metrics, vm);
+        write_trace(trace, vm);
+        return 0;
+    }
+
+    const Stopwatch<std::chrono::high_resolution_clock> read_start;
+    std::vector<Star> stars;
+    if (shared) {
+        const auto catalog = StarCatalog::attach(vm[OPT_SHARED].as<std::string>(), metrics_ptr);
+        if (catalog.epoch())
+            log_info("Epoch: J%1%%2%", *catalog.epoch(), catalog.apparent() ? " (apparent places)" : "");
+        image_options.window->epoch = catalog.epoch();
+
+        stars = catalog.query(filter, metrics_ptr);
+        log_info("Total stars read and filtered: %1%", stars.size());
+        log_info("Total rows skipped: %1%", catalog.skipped_rows());
+    } else if (epoch) {
+        // Apparent places move the stars, so cache zones can not be skipped
+        auto catalog = StarCatalog::load(catalog_options, apparent ? nullptr : &filter, metrics_ptr);
+
+        if (apparent) {
+            const Stopwatch<std::chrono::high_resolution_clock> apparent_start;
+            catalog.apply_apparent_place(*apparent);
+            log_info("Time taken to compute apparent places: %1%", apparent_start.elapsed());
+        }
+
+        stars = catalog.query(filter, metrics_ptr);
+        log_info("Total stars read and filtered: %1%", stars.size());
+        log_info("Total rows skipped: %1%", catalog.skipped_rows());
+        if (metrics)
+            metrics->add_count(Counter::skipped_rows, catalog.skipped_rows());
+    } else {
+        StarBlockSource source(catalog_options, metrics_ptr);
+        source.push_down(filter);
+        stars = read_stars_with_supplements(source, !supplement_paths.empty(), filter, metrics_ptr);
+    }
     const auto read_duration = read_start.elapsed();
 
-    std::cout << "Time taken to read and filter stars: " << read_duration << std::endl;
-    std::cout << "Total stars after filtering: " << stars.size() << std::endl;
-    std::cout << std::endl;
+    log_info("Time taken to read and filter stars: %1%", read_duration);
+    log_info("Total stars after filtering: %1%", stars.size());
+    log_info("");
 
     {
         const uint32_t display_count = vm[OPT_DISPLAY_COUNT].as<uint32_t>();
-        std::cout << boost::format("First %1% stars:") % display_count << std::endl;
+        log_progress("First %1% stars:", display_count);
         uint32_t i = 0;
         for (const auto& star : stars) {
             if (i >= display_count && display_count != 0)
                 break;
-            std::cout << boost::format("Star %1%: RA=%2$.2f, Dec=%3$.2f, Mag=%4$.2f") % i % star.ra_deg % star.de_deg % star.mag << std::endl;
+            log_progress("Star %1%: RA=%2$.2f, Dec=%3$.2f, Mag=%4$.2f", i, star.ra_deg, star.de_deg, star.mag);
             i++;
         }
     }
 
     cv::Mat img;
     const Stopwatch<std::chrono::high_resolution_clock> render_start;
-    render_stars(
+    const auto scale = render_stars(
         stars,
+        order,
         vm[OPT_WIDTH].as<uint32_t>(),
         vm[OPT_HEIGHT].as<uint32_t>(),
         vm[OPT_MIN_RA].as<double>(),
         vm[OPT_MAX_RA].as<double>(),
         vm[OPT_MIN_DEC].as<double>(),
         vm[OPT_MAX_DEC].as<double>(),
-        img
+        min_magnitude,
+        depth,
+        img,
+        metrics_ptr
     );
-    cv::imwrite(vm[OPT_OUTPUT].as<std::string>(), img);
+    log_info("Magnitude range: %1$.3f to %2$.3f", scale.min_mag, scale.max_mag);
     const auto render_duration = render_start.elapsed();
 
-    std::cout << "Time taken to render and save image: " << render_duration << std::endl;
-    std::cout << "Image saved as: " << vm[OPT_OUTPUT].as<std::string>() << std::endl;
-    std::cout << "Total time elapsed: " << read_start.elapsed() << std::endl;
+    const Stopwatch<std::chrono::high_resolution_clock> save_start;
+    write_image(vm[OPT_OUTPUT].as<std::string>(), img, image_options, metrics_ptr);
+    const auto save_duration = save_start.elapsed();
+
+    log_info("Time taken to render image: %1%", render_duration);
+    log_info("Time taken to encode and save image: %1%", save_duration);
+    log_info("Image saved as: %1%", vm[OPT_OUTPUT].as<std::string>());
+    log_info("Total time elapsed: %1%", read_start.elapsed());
+    write_metrics(metrics, vm);
+    write_trace(trace, vm);
 
     return 0;
-}
\ No newline at end of file
+}
+
+
+int main(int argc, char** argv) {
+    try {
+        return run(argc, argv);
+    }
+    catch (...) {
+        // Write what was logged before the error ends the program
+        flush_log();
+        throw;
+    }
+}
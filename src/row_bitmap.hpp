@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * \brief   One bit per catalog row, e.g. for the rows that were skipped.
+ */
+class RowBitmap {
+    public:
+        /**
+         * \brief   Sets the bit of a row, growing the bitmap if needed.
+         */
+        void set(const std::size_t row) {
+            if (row >= rows)
+                resize(row + 1);
+            bits[row / 64] |= uint64_t(1) << (row % 64);
+        }
+
+        bool test(const std::size_t row) const noexcept {
+            return row < rows && ((bits[row / 64] >> (row % 64)) & 1) != 0;
+        }
+
+        /**
+         * \brief   Sets the number of rows; new rows are clear.
+         */
+        void resize(const std::size_t count) {
+            rows = count;
+            bits.resize((count + 63) / 64);
+            if (count % 64 != 0)
+                bits.back() &= (uint64_t(1) << (count % 64)) - 1;
+        }
+
+        /// Number of rows
+        std::size_t size() const noexcept {
+            return rows;
+        }
+
+        /// Number of set bits
+        std::size_t count() const noexcept {
+            std::size_t set = 0;
+            for (const auto word : bits)
+                set += __builtin_popcountll(word);
+            return set;
+        }
+
+        /// Bits of rows 64 * i to 64 * i + 63, least significant first
+        std::vector<uint64_t>& words() noexcept {
+            return bits;
+        }
+
+        const std::vector<uint64_t>& words() const noexcept {
+            return bits;
+        }
+
+    private:
+        std::vector<uint64_t> bits;
+        std::size_t rows = 0;
+};
@@ -0,0 +1,321 @@
+#include "shared_catalog.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <boost/format.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace {
+
+constexpr char SEGMENT_MAGIC[8] = {'S', 'F', 'S', 'H', 'A', 'R', 'E', '\0'};
+constexpr uint32_t SEGMENT_VERSION = 1;
+
+
+/**
+ * \brief   Fixed-size header at the start of a segment.
+ *
+ * It is followed by the zone maps, the RA, Dec and magnitude columns and the
+ * magnitude source column, in that order, so the double columns stay 8-byte
+ * aligned.
+ */
+struct SegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t apparent;
+    /// Epoch of the positions, NaN for observed positions
+    double epoch;
+    uint64_t rows;
+    uint64_t skipped_rows;
+    uint64_t zone_rows;
+    /// Size of the header, zone maps and columns
+    uint64_t bytes;
+};
+
+
+std::size_t zone_count(const std::size_t rows) noexcept {
+    return (rows + CACHE_ZONE_ROWS - 1) / CACHE_ZONE_ROWS;
+}
+
+
+std::size_t zones_offset() noexcept {
+    return sizeof(SegmentHeader);
+}
+
+
+std::size_t columns_offset(const std::size_t rows) noexcept {
+    return zones_offset() + zone_count(rows) * sizeof(ZoneMap);
+}
+
+
+std::size_t segment_bytes(const std::size_t rows) noexcept {
+    return columns_offset(rows) + rows * (3 * sizeof(double) + sizeof(uint8_t));
+}
+
+
+/// Where Linux keeps POSIX shared memory objects
+constexpr char SHM_DIR[] = "/dev/shm/";
+
+
+/**
+ * \brief   Path of the segment file: the name itself if it holds a '/', else an object in /dev/shm.
+ */
+std::string segment_path(const std::string& name) {
+    if (name.find('/') != std::string::npos)
+        return name;
+    return SHM_DIR + name;
+}
+
+
+std::runtime_error segment_error(
+        const char* what,
+        const std::string& name,
+        const int error
+) {
+    return std::runtime_error(
+        (
+            boost::format("%1% shared catalog %2%: %3%") % what % name % std::strerror(error)
+        ).str()
+    );
+}
+
+
+std::runtime_error damaged(const std::string& name) {
+    return std::runtime_error(
+        (
+            boost::format("Shared catalog %1% is damaged or of another version") % name
+        ).str()
+    );
+}
+
+
+/**
+ * \brief   Computes the bounds of every CACHE_ZONE_ROWS rows of the table.
+ */
+void fill_zones(
+        const StarColumnsView& columns,
+        ZoneMap* zones
+) {
+    constexpr auto inf = std::numeric_limits<double>::infinity();
+    for (std::size_t zone = 0; zone < zone_count(columns.size()); zone++) {
+        ZoneMap bounds{inf, -inf, inf, -inf, inf, -inf};
+        const auto end = std::min((zone + 1) * CACHE_ZONE_ROWS, columns.size());
+        for (std::size_t i = zone * CACHE_ZONE_ROWS; i < end; i++) {
+            bounds.min_ra = std::min(bounds.min_ra, columns.ra_deg[i]);
+            bounds.max_ra = std::max(bounds.max_ra, columns.ra_deg[i]);
+            bounds.min_dec = std::min(bounds.min_dec, columns.de_deg[i]);
+            bounds.max_dec = std::max(bounds.max_dec, columns.de_deg[i]);
+            bounds.min_mag = std::min(bounds.min_mag, columns.mag[i]);
+            bounds.max_mag = std::max(bounds.max_mag, columns.mag[i]);
+        }
+        zones[zone] = bounds;
+    }
+}
+
+
+template <class T>
+char* copy_column(
+        char* dst,
+        const T* column,
+        const std::size_t rows
+) {
+    std::memcpy(dst, column, rows * sizeof(T));
+    return dst + rows * sizeof(T);
+}
+
+
+const SegmentHeader& header_of(const void* data) noexcept {
+    return *static_cast<const SegmentHeader*>(data);
+}
+
+}
+
+
+void SharedStarTable::publish(
+        const std::string& name,
+        const StarColumnsView& columns,
+        const std::size_t skipped_rows,
+        const std::optional<double>& epoch,
+        const bool apparent
+) {
+    const auto bytes = segment_bytes(columns.size());
+
+    // Built under a private name and renamed over the old segment once complete,
+    // so attaching processes see either one in full; attached ones keep the old
+    const auto path = segment_path(name);
+    const auto tmp_path = (boost::format("%1%.%2%.tmp") % path % ::getpid()).str();
+    const int fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        throw segment_error("Failed to create", name, errno);
+
+    // Huge page backed files can only be sized and mapped in whole pages
+    struct stat status;
+    std::size_t size = bytes;
+    if (::fstat(fd, &status) == 0 && status.st_blksize > 0)
+        size = (bytes + status.st_blksize - 1) / status.st_blksize * status.st_blksize;
+
+    void* data = MAP_FAILED;
+    if (::ftruncate(fd, size) == 0)
+        data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int error = errno;
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        ::unlink(tmp_path.c_str());
+        throw segment_error("Failed to allocate", name, error);
+    }
+
+    const auto base = static_cast<char*>(data);
+    fill_zones(columns, reinterpret_cast<ZoneMap*>(base + zones_offset()));
+    auto column = base + columns_offset(columns.size());
+    column = copy_column(column, columns.ra_deg, columns.size());
+    column = copy_column(column, columns.de_deg, columns.size());
+    column = copy_column(column, columns.mag, columns.size());
+    copy_column(column, columns.mag_sources, columns.size());
+
+    auto& header = *reinterpret_cast<SegmentHeader*>(base);
+    header.version = SEGMENT_VERSION;
+    header.apparent = apparent ? 1 : 0;
+    header.epoch = epoch.value_or(std::nan(""));
+    header.rows = columns.size();
+    header.skipped_rows = skipped_rows;
+    header.zone_rows = CACHE_ZONE_ROWS;
+    header.bytes = bytes;
+    std::memcpy(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    ::munmap(data, size);
+
+    if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        const int error = errno;
+        ::unlink(tmp_path.c_str());
+        throw segment_error("Failed to publish", name, error);
+    }
+}
+
+
+SharedStarTable SharedStarTable::attach(const std::string& name) {
+    const int fd = ::open(segment_path(name).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw segment_error("Failed to open", name, errno);
+
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+        const int error = errno;
+        ::close(fd);
+        throw segment_error("Failed to open", name, error);
+    }
+    const auto size = static_cast<std::size_t>(status.st_size);
+    if (size < sizeof(SegmentHeader)) {
+        ::close(fd);
+        throw damaged(name);
+    }
+
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    const int error = errno;
+    ::close(fd);
+    if (data == MAP_FAILED)
+        throw segment_error("Failed to map", name, error);
+
+    // Unmaps on every error below
+    SharedStarTable table(data, size);
+    const auto& header = header_of(data);
+    if (
+        std::memcmp(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0
+        ||
+        header.version != SEGMENT_VERSION
+        ||
+        header.zone_rows != CACHE_ZONE_ROWS
+        ||
+        header.bytes != segment_bytes(header.rows)
+        ||
+        header.bytes > size
+    )
+        throw damaged(name);
+    return table;
+}
+
+
+void SharedStarTable::remove(const std::string& name) {
+    if (::unlink(segment_path(name).c_str()) != 0)
+        throw segment_error("Failed to remove", name, errno);
+}
+
+
+SharedStarTable::SharedStarTable(
+            const void* data,
+            const std::size_t size
+):
+        data(data),
+        size(size)
+{}
+
+
+SharedStarTable::SharedStarTable(SharedStarTable&& other) noexcept:
+        data(other.data),
+        size(other.size)
+{
+    other.data = nullptr;
+    other.size = 0;
+}
+
+
+SharedStarTable& SharedStarTable::operator=(SharedStarTable&& other) noexcept {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+    return *this;
+}
+
+
+SharedStarTable::~SharedStarTable() {
+    if (data)
+        ::munmap(const_cast<void*>(data), size);
+}
+
+
+StarColumnsView SharedStarTable::columns() const noexcept {
+    const auto rows = header_of(data).rows;
+    const auto ra = reinterpret_cast<const double*>(static_cast<const char*>(data) + columns_offset(rows));
+    return StarColumnsView(
+        ra,
+        ra + rows,
+        ra + 2 * rows,
+        reinterpret_cast<const uint8_t*>(ra + 3 * rows),
+        rows
+    );
+}
+
+
+const ZoneMap* SharedStarTable::zones() const noexcept {
+    return reinterpret_cast<const ZoneMap*>(static_cast<const char*>(data) + zones_offset());
+}
+
+
+std::size_t SharedStarTable::skipped_rows() const noexcept {
+    return header_of(data).skipped_rows;
+}
+
+
+std::optional<double> SharedStarTable::epoch() const noexcept {
+    const auto epoch = header_of(data).epoch;
+    if (std::isnan(epoch))
+        return std::nullopt;
+    return epoch;
+}
+
+
+bool SharedStarTable::apparent() const noexcept {
+    return header_of(data).apparent != 0;
+}
+
+
+std::size_t SharedStarTable::bytes() const noexcept {
+    return size;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+#include "star_cache.hpp"
+#include "star_columns.hpp"
+
+
+/**
+ * \brief   Star table published in a shared memory segment, mapped read-only.
+ *
+ * One process loads the catalog and publishes its columns together with the
+ * zone maps of CACHE_ZONE_ROWS rows; any number of processes on the host then
+ * attach to the segment. Attaching only maps it, so the table is shared by
+ * all of them rather than copied, and queries can start at once.
+ *
+ * A name holding a '/' is the path of a file, e.g. on a hugetlbfs mount to
+ * back the table with huge pages; any other name is a POSIX shared memory
+ * object, which Linux keeps in /dev/shm.
+ */
+class SharedStarTable {
+    public:
+        /**
+         * \brief   Publishes a star table, replacing a segment of the same name.
+         *
+         * The segment is built under a temporary name next to it and renamed
+         * into place, so processes attaching meanwhile get the old segment,
+         * and those attached to it keep it until they detach.
+         *
+         * \param   skipped_rows    catalog rows that could not be parsed
+         * \param   epoch           epoch of the positions, or nothing for the observed positions
+         * \param   apparent        whether the positions are apparent places
+         * \throw   std::runtime_error if the segment can not be created
+         */
+        static void publish(
+                const std::string& name,
+                const StarColumnsView& columns,
+                const std::size_t skipped_rows,
+                const std::optional<double>& epoch,
+                const bool apparent
+        );
+
+        /**
+         * \brief   Maps a published segment read-only.
+         *
+         * \throw   std::runtime_error if there is no such segment, or it is
+         *          damaged or of another version
+         */
+        static SharedStarTable attach(const std::string& name);
+
+        /**
+         * \brief   Removes a published segment; attached processes keep it until they detach.
+         *
+         * \throw   std::runtime_error if there is no such segment
+         */
+        static void remove(const std::string& name);
+
+        SharedStarTable(SharedStarTable&& other) noexcept;
+        SharedStarTable& operator=(SharedStarTable&& other) noexcept;
+        SharedStarTable(const SharedStarTable&) = delete;
+        SharedStarTable& operator=(const SharedStarTable&) = delete;
+
+        ~SharedStarTable();
+
+        StarColumnsView columns() const noexcept;
+
+        /// Zone maps, one per CACHE_ZONE_ROWS rows
+        const ZoneMap* zones() const noexcept;
+
+        std::size_t skipped_rows() const noexcept;
+
+        std::optional<double> epoch() const noexcept;
+
+        bool apparent() const noexcept;
+
+        /// Size of the mapping
+        std::size_t bytes() const noexcept;
+
+    private:
+        SharedStarTable(
+                    const void* data,
+                    const std::size_t size
+        );
+
+        const void* data;
+        std::size_t size;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+
+/**
+ * \brief   Represents a star with its right ascension, declination, and magnitude.
+ */
+struct Star {
+    const double ra_deg;
+    const double de_deg;
+    const double mag;
+
+    Star(
+                const double ra_deg,
+                const double de_deg,
+                const double mag
+    ) noexcept:
+            ra_deg(ra_deg),
+            de_deg(de_deg),
+            mag(mag)
+    {}
+};
+
+
+/**
+ * \brief   Sky window and magnitude limit of a query.
+ */
+struct StarFilter {
+    double min_ra;
+    double max_ra;
+    double min_dec;
+    double max_dec;
+    double max_magnitude;
+
+    bool accepts(
+                const double ra,
+                const double dec,
+                const double mag
+    ) const noexcept {
+        return (
+            ra >= min_ra
+            &&
+            ra <= max_ra
+            &&
+            dec >= min_dec
+            &&
+            dec <= max_dec
+            &&
+            mag <= max_magnitude
+        );
+    }
+};
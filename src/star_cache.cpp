@@ -0,0 +1,562 @@
+#include "star_cache.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <tuple>
+#include <boost/format.hpp>
+
+#include <unistd.h>
+
+
+namespace fs = std::filesystem;
+
+
+namespace {
+
+constexpr char CACHE_MAGIC[8] = {'S', 'F', 'C', 'A', 'C', 'H', 'E', '\0'};
+constexpr uint32_t CACHE_VERSION = 5;
+constexpr std::size_t COPY_BUFFER_SIZE = 1 << 20;
+
+
+/**
+ * \brief   Fixed-size header at the start of a cache file.
+ *
+ * It is followed by the zone maps, the skip bitmap of the main catalog, the
+ * RA, Dec and magnitude columns and the magnitude source column (see
+ * MagnitudeFunction), in that order. The bitmap comes first so that the
+ * double columns stay 8-byte aligned.
+ */
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    /// Declination bands the rows are sorted into, zero for catalog order
+    uint32_t dec_bands;
+    uint64_t source_stamp;
+    /// Target epoch, NaN for observed positions
+    double epoch;
+    uint64_t rows;
+    uint64_t skipped_rows;
+    uint64_t zone_rows;
+    /// Data rows of the main catalog, the bits of the skip bitmap
+    uint64_t catalog_rows;
+};
+
+
+std::size_t zone_count(const std::size_t rows) noexcept {
+    return (rows + CACHE_ZONE_ROWS - 1) / CACHE_ZONE_ROWS;
+}
+
+
+std::size_t bitmap_words(const std::size_t catalog_rows) noexcept {
+    return (catalog_rows + 63) / 64;
+}
+
+
+std::streamoff bitmap_offset(const std::size_t rows) noexcept {
+    return sizeof(CacheHeader) + zone_count(rows) * sizeof(ZoneMap);
+}
+
+
+std::streamoff columns_offset(
+        const std::size_t rows,
+        const std::size_t catalog_rows
+) noexcept {
+    return bitmap_offset(rows) + bitmap_words(catalog_rows) * sizeof(uint64_t);
+}
+
+
+/// Bytes per cache row: RA, Dec, magnitude and magnitude sources
+constexpr std::size_t ROW_BYTES = 3 * sizeof(double) + sizeof(uint8_t);
+
+
+/**
+ * \brief   FNV-1a hash over the names, sizes and modification times of the source files.
+ */
+uint64_t source_stamp(const std::vector<std::string>& source_paths) {
+    uint64_t hash = 14695981039346656037ull;
+    const auto mix = [&hash] (const void* data, const std::size_t size) {
+        const auto bytes = static_cast<const unsigned char*>(data);
+        for (std::size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+
+    for (const auto& path : source_paths) {
+        const auto name = fs::path(path).filename().string();
+        const uint64_t size = fs::file_size(path);
+        const int64_t mtime = fs::last_write_time(path).time_since_epoch().count();
+        mix(name.data(), name.size());
+        mix(&size, sizeof(size));
+        mix(&mtime, sizeof(mtime));
+    }
+    return hash;
+}
+
+
+double encode_epoch(const std::optional<double>& epoch) {
+    return epoch.value_or(std::nan(""));
+}
+
+
+bool same_epoch(
+        const double stored,
+        const std::optional<double>& epoch
+) {
+    if (!epoch)
+        return std::isnan(stored);
+    return stored == *epoch;
+}
+
+
+template <class T>
+void read_column(
+        std::ifstream& file,
+        const std::streamoff offset,
+        std::vector<T>& column,
+        const std::size_t rows
+) {
+    column.resize(rows);
+    file.seekg(offset);
+    file.read(reinterpret_cast<char*>(column.data()), rows * sizeof(T));
+}
+
+
+template <class T>
+void write_column(
+        std::ofstream& file,
+        const std::vector<T>& column
+) {
+    file.write(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+}
+
+
+/**
+ * \brief   Appends a spooled column to the cache file and widens the zone bounds of its rows.
+ *
+ * \param   row     index of the first row of the spool; advanced past it
+ */
+void copy_column(
+        const std::string& path,
+        std::ofstream& dst,
+        std::vector<ZoneMap>& zones,
+        double ZoneMap::* const min,
+        double ZoneMap::* const max,
+        std::size_t& row
+) {
+    std::ifstream src(path, std::ios::binary);
+    std::vector<double> buffer(COPY_BUFFER_SIZE / sizeof(double));
+    while (src) {
+        src.read(reinterpret_cast<char*>(buffer.data()), buffer.size() * sizeof(double));
+        const auto count = static_cast<std::size_t>(src.gcount()) / sizeof(double);
+        dst.write(reinterpret_cast<const char*>(buffer.data()), count * sizeof(double));
+
+        for (std::size_t i = 0; i < count; ) {
+            auto& zone = zones[row / CACHE_ZONE_ROWS];
+            const auto end = std::min(count, i + CACHE_ZONE_ROWS - row % CACHE_ZONE_ROWS);
+            auto lo = zone.*min;
+            auto hi = zone.*max;
+            for (std::size_t j = i; j < end; j++) {
+                lo = std::min(lo, buffer[j]);
+                hi = std::max(hi, buffer[j]);
+            }
+            zone.*min = lo;
+            zone.*max = hi;
+            row += end - i;
+            i = end;
+        }
+    }
+}
+
+
+/**
+ * \brief   Name for the temporary files of a cache writer, unique among processes and writers.
+ */
+std::string unique_tmp_path(const std::string& cache_path) {
+    static std::atomic<uint64_t> writers(0);
+    return (boost::format("%1%.%2%.%3%.tmp") % cache_path % ::getpid() % writers++).str();
+}
+
+
+/**
+ * \brief   Appends a spooled column to the cache file as it is.
+ */
+void copy_file(
+        const std::string& path,
+        std::ofstream& dst
+) {
+    std::ifstream src(path, std::ios::binary);
+    std::vector<char> buffer(COPY_BUFFER_SIZE);
+    while (src) {
+        src.read(buffer.data(), buffer.size());
+        dst.write(buffer.data(), src.gcount());
+    }
+}
+
+}
+
+
+std::string star_cache_path(
+        const std::string& cache_dir,
+        const std::string& catalog_path,
+        const std::string& format_name,
+        const std::optional<double>& epoch,
+        const uint32_t dec_bands
+) {
+    const fs::path catalog(catalog_path);
+    const fs::path dir = cache_dir.empty() ? catalog.parent_path() : fs::path(cache_dir);
+    auto name = epoch
+        ? (boost::format("%1%.%2%.J%3$.3f") % catalog.filename().string() % format_name % *epoch).str()
+        : (boost::format("%1%.%2%.observed") % catalog.filename().string() % format_name).str();
+    if (dec_bands != 0)
+        name += (boost::format(".dec%1%") % dec_bands).str();
+    return (dir / (name + ".cache")).string();
+}
+
+
+StarCacheReader::StarCacheReader(
+            std::ifstream&& file,
+            const std::size_t rows,
+            const std::size_t skipped_rows,
+            RowBitmap&& skipped_catalog_rows,
+            std::vector<ZoneMap>&& zones
+):
+        file(std::move(file)),
+        total_rows(rows),
+        total_skipped_rows(skipped_rows),
+        catalog_skips(std::move(skipped_catalog_rows)),
+        position(0),
+        zone_maps(std::move(zones)),
+        zones_skipped(0)
+{}
+
+
+std::optional<StarCacheReader> StarCacheReader::open(
+        const std::string& cache_path,
+        const std::vector<std::string>& source_paths,
+        const std::optional<double>& epoch,
+        const uint32_t dec_bands
+) {
+    std::ifstream file(cache_path, std::ios::binary);
+    if (!file)
+        return std::nullopt;
+
+    CacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return std::nullopt;
+
+    uint64_t expected_stamp;
+    try {
+        expected_stamp = source_stamp(source_paths);
+    }
+    catch (const fs::filesystem_error&) {
+        return std::nullopt;
+    }
+
+    if (
+            std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+            ||
+            header.version != CACHE_VERSION
+            ||
+            header.source_stamp != expected_stamp
+            ||
+            !same_epoch(header.epoch, epoch)
+            ||
+            header.dec_bands != dec_bands
+            ||
+            header.zone_rows != CACHE_ZONE_ROWS
+    )
+        return std::nullopt;
+
+    // A truncated file is as good as a missing one
+    const auto expected_size = columns_offset(header.rows, header.catalog_rows) + header.rows * ROW_BYTES;
+    std::error_code error;
+    if (fs::file_size(cache_path, error) != static_cast<uintmax_t>(expected_size) || error)
+        return std::nullopt;
+
+    std::vector<ZoneMap> zones(zone_count(header.rows));
+    if (!file.read(reinterpret_cast<char*>(zones.data()), zones.size() * sizeof(ZoneMap)))
+        return std::nullopt;
+
+    RowBitmap skipped_catalog_rows;
+    skipped_catalog_rows.resize(header.catalog_rows);
+    auto& words = skipped_catalog_rows.words();
+    if (!file.read(reinterpret_cast<char*>(words.data()), words.size() * sizeof(uint64_t)))
+        return std::nullopt;
+
+    return StarCacheReader(
+        std::move(file),
+        header.rows,
+        header.skipped_rows,
+        std::move(skipped_catalog_rows),
+        std::move(zones)
+    );
+}
+
+
+std::size_t StarCacheReader::rows() const noexcept {
+    return total_rows;
+}
+
+
+std::size_t StarCacheReader::skipped_rows() const noexcept {
+    return total_skipped_rows;
+}
+
+
+const RowBitmap& StarCacheReader::skipped_catalog_rows() const noexcept {
+    return catalog_skips;
+}
+
+
+const std::vector<ZoneMap>& StarCacheReader::zones() const noexcept {
+    return zone_maps;
+}
+
+
+std::size_t StarCacheReader::skipped_zones() const noexcept {
+    return zones_skipped;
+}
+
+
+bool StarCacheReader::read_block(
+        StarColumns& block,
+        const std::size_t max_rows
+) {
+    const auto count = std::min(max_rows, total_rows - position);
+    if (count == 0)
+        return false;
+
+    const std::streamoff column_size = total_rows * sizeof(double);
+    const std::streamoff columns = columns_offset(total_rows, catalog_skips.size());
+    const std::streamoff offset = columns + position * sizeof(double);
+    read_column(file, offset, block.ra_deg, count);
+    read_column(file, offset + column_size, block.de_deg, count);
+    read_column(file, offset + 2 * column_size, block.mag, count);
+    read_column(file, columns + 3 * column_size + position, block.mag_sources, count);
+    if (!file)
+        throw std::runtime_error("Cache file is truncated");
+
+    position += count;
+    return true;
+}
+
+
+bool StarCacheReader::read_block(
+        StarColumns& block,
+        const StarFilter& filter
+) {
+    for (; position < total_rows; position = std::min(total_rows, position + CACHE_ZONE_ROWS)) {
+        if (zone_maps[position / CACHE_ZONE_ROWS].may_match(filter))
+            return read_block(block, CACHE_ZONE_ROWS);
+        zones_skipped++;
+    }
+    return false;
+}
+
+
+StarCacheWriter::StarCacheWriter(
+            const std::string& cache_path,
+            const std::vector<std::string>& source_paths,
+            const std::optional<double>& epoch,
+            const uint32_t dec_bands
+):
+        cache_path(cache_path),
+        tmp_path(unique_tmp_path(cache_path)),
+        source_paths(source_paths),
+        epoch(epoch),
+        dec_bands(dec_bands),
+        spools(std::max<uint32_t>(dec_bands, 1)),
+        band_blocks(dec_bands),
+        rows(0),
+        finished(false)
+{}
+
+
+StarCacheWriter::~StarCacheWriter() {
+    std::error_code error;
+    for (std::size_t band = 0; band < spools.size(); band++) {
+        auto& spool = spools[band];
+        if (!spool.opened)
+            continue;
+        spool.ra_file.close();
+        spool.de_file.close();
+        spool.mag_file.close();
+        spool.sources_file.close();
+        fs::remove(spool_path(band, "ra"), error);
+        fs::remove(spool_path(band, "de"), error);
+        fs::remove(spool_path(band, "mag"), error);
+        fs::remove(spool_path(band, "sources"), error);
+    }
+    if (!finished)
+        fs::remove(tmp_path, error);
+}
+
+
+std::string StarCacheWriter::spool_path(
+        const std::size_t band,
+        const char* column
+) const {
+    if (dec_bands == 0)
+        return (boost::format("%1%.%2%") % tmp_path % column).str();
+    return (boost::format("%1%.%2%.%3%") % tmp_path % band % column).str();
+}
+
+
+void StarCacheWriter::write_spool(
+        const std::size_t band,
+        const StarColumns& block
+) {
+    auto& spool = spools[band];
+    if (!spool.opened) {
+        spool.ra_file.open(spool_path(band, "ra"), std::ios::binary | std::ios::trunc);
+        spool.de_file.open(spool_path(band, "de"), std::ios::binary | std::ios::trunc);
+        spool.mag_file.open(spool_path(band, "mag"), std::ios::binary | std::ios::trunc);
+        spool.sources_file.open(spool_path(band, "sources"), std::ios::binary | std::ios::trunc);
+        spool.opened = true;
+    }
+    write_column(spool.ra_file, block.ra_deg);
+    write_column(spool.de_file, block.de_deg);
+    write_column(spool.mag_file, block.mag);
+    write_column(spool.sources_file, block.mag_sources);
+}
+
+
+void StarCacheWriter::append(const StarColumns& block) {
+    rows += block.size();
+    if (dec_bands == 0) {
+        write_spool(0, block);
+        return;
+    }
+
+    for (std::size_t i = 0; i < block.size(); i++) {
+        const auto band = std::min<std::size_t>(
+            dec_bands - 1,
+            static_cast<std::size_t>(std::max(0.0, (block.de_deg[i] + 90.0) / 180.0 * dec_bands))
+        );
+        band_blocks[band].push_back(block.ra_deg[i], block.de_deg[i], block.mag[i], block.mag_sources[i]);
+    }
+    for (std::size_t band = 0; band < band_blocks.size(); band++) {
+        if (band_blocks[band].size() == 0)
+            continue;
+        write_spool(band, band_blocks[band]);
+        band_blocks[band].clear();
+    }
+}
+
+
+void StarCacheWriter::finish(
+        const std::size_t skipped_rows,
+        const RowBitmap& skipped_catalog_rows
+) {
+    for (auto& spool : spools) {
+        if (!spool.opened)
+            continue;
+        spool.ra_file.close();
+        spool.de_file.close();
+        spool.mag_file.close();
+        spool.sources_file.close();
+        if (!spool.ra_file || !spool.de_file || !spool.mag_file || !spool.sources_file)
+            throw std::runtime_error(
+                (
+                    boost::format("Failed to write cache columns for %1%") % cache_path
+                ).str()
+            );
+    }
+
+    CacheHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.dec_bands = dec_bands;
+    header.source_stamp = source_stamp(source_paths);
+    header.epoch = encode_epoch(epoch);
+    header.rows = rows;
+    header.skipped_rows = skipped_rows;
+    header.zone_rows = CACHE_ZONE_ROWS;
+    header.catalog_rows = skipped_catalog_rows.size();
+
+    constexpr auto inf = std::numeric_limits<double>::infinity();
+    std::vector<ZoneMap> zones(zone_count(rows), ZoneMap{inf, -inf, inf, -inf, inf, -inf});
+
+    // Write to a temporary file first, so concurrent readers never see a partial cache
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        // Zone maps are known once the columns have been copied
+        file.write(reinterpret_cast<const char*>(zones.data()), zones.size() * sizeof(ZoneMap));
+        write_column(file, skipped_catalog_rows.words());
+
+        const std::tuple<const char*, double ZoneMap::*, double ZoneMap::*> columns[] = {
+            {"ra", &ZoneMap::min_ra, &ZoneMap::max_ra},
+            {"de", &ZoneMap::min_dec, &ZoneMap::max_dec},
+            {"mag", &ZoneMap::min_mag, &ZoneMap::max_mag},
+        };
+        for (const auto& [column, min, max] : columns) {
+            std::size_t row = 0;
+            for (std::size_t band = 0; band < spools.size(); band++)
+                if (spools[band].opened)
+                    copy_column(spool_path(band, column), file, zones, min, max, row);
+        }
+        for (std::size_t band = 0; band < spools.size(); band++)
+            if (spools[band].opened)
+                copy_file(spool_path(band, "sources"), file);
+
+        file.seekp(sizeof(header));
+        file.write(reinterpret_cast<const char*>(zones.data()), zones.size() * sizeof(ZoneMap));
+        if (!file)
+            throw std::runtime_error(
+                (
+                    boost::format("Failed to write cache file %1%") % tmp_path
+                ).str()
+            );
+    }
+    fs::rename(tmp_path, cache_path);
+    finished = true;
+}
+
+
+std::optional<StarCache> load_star_cache(
+        const std::string& cache_path,
+        const std::vector<std::string>& source_paths,
+        const std::optional<double>& epoch,
+        const uint32_t dec_bands,
+        const StarFilter* filter
+) {
+    auto reader = StarCacheReader::open(cache_path, source_paths, epoch, dec_bands);
+    if (!reader)
+        return std::nullopt;
+
+    StarCache cache;
+    cache.skipped_rows = reader->skipped_rows();
+    cache.skipped_catalog_rows = reader->skipped_catalog_rows();
+    try {
+        if (filter) {
+            StarColumns block;
+            while (reader->read_block(block, *filter))
+                cache.columns.append(block);
+        } else {
+            reader->read_block(cache.columns, reader->rows());
+        }
+    }
+    catch (const std::runtime_error&) {
+        return std::nullopt;
+    }
+    return cache;
+}
+
+
+void save_star_cache(
+        const std::string& cache_path,
+        const std::vector<std::string>& source_paths,
+        const std::optional<double>& epoch,
+        const StarCache& cache,
+        const uint32_t dec_bands
+) {
+    StarCacheWriter writer(cache_path, source_paths, epoch, dec_bands);
+    writer.append(cache.columns);
+    writer.finish(cache.skipped_rows, cache.skipped_catalog_rows);
+}
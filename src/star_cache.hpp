@@ -0,0 +1,271 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "row_bitmap.hpp"
+#include "star.hpp"
+#include "star_columns.hpp"
+
+
+/// Rows per zone map entry of a cache file
+constexpr std::size_t CACHE_ZONE_ROWS = 65536;
+
+
+/**
+ * \brief   Star table restored from (or about to be stored in) a binary cache file.
+ */
+struct StarCache {
+    StarColumns columns;
+    std::size_t skipped_rows = 0;
+    /// Skipped rows of the main catalog, one bit per data row
+    RowBitmap skipped_catalog_rows;
+};
+
+
+/**
+ * \brief   Bounds of the RA, Dec and magnitude columns over one block of cache rows.
+ */
+struct ZoneMap {
+    double min_ra;
+    double max_ra;
+    double min_dec;
+    double max_dec;
+    double min_mag;
+    double max_mag;
+
+    /**
+     * \return  false if no star of the block can pass the filter
+     */
+    bool may_match(const StarFilter& filter) const noexcept {
+        return (
+            max_ra >= filter.min_ra
+            &&
+            min_ra <= filter.max_ra
+            &&
+            max_dec >= filter.min_dec
+            &&
+            min_dec <= filter.max_dec
+            &&
+            min_mag <= filter.max_magnitude
+        );
+    }
+};
+
+
+/**
+ * \brief   Builds the cache file name for the given catalog and epoch.
+ *
+ * \param   cache_dir       directory for cache files; empty means next to the catalog
+ * \param   catalog_path    path to the source catalog
+ * \param   format_name     catalog format the file is parsed as; the same file
+ *                          read as another format gets another cache
+ * \param   epoch           target epoch of the cached positions, Julian years;
+ *                          nothing for the observed catalog positions
+ * \param   dec_bands       row order of the cache, see StarCacheWriter; caches
+ *                          in different orders get different names
+ */
+std::string star_cache_path(
+        const std::string& cache_dir,
+        const std::string& catalog_path,
+        const std::string& format_name,
+        const std::optional<double>& epoch,
+        const uint32_t dec_bands = 0
+);
+
+
+/**
+ * \brief   Reads a cache file column block by column block.
+ *
+ * Only one block is held in memory, so a cache larger than RAM can be scanned.
+ * The zone maps in the file let a filtered scan skip blocks that hold no
+ * matching star without reading them.
+ */
+class StarCacheReader {
+    public:
+        /**
+         * \brief   Opens a cache file.
+         *
+         * \param   cache_path      path to the cache file
+         * \param   source_paths    catalog files the table was built from
+         * \param   epoch           target epoch of the cached positions, or nothing for observed positions
+         * \param   dec_bands       row order the cache must have, see StarCacheWriter
+         * \return  nothing if the cache is missing, damaged, or was built from a
+         *          different set or version of the catalog files, for another
+         *          epoch or in another row order
+         */
+        static std::optional<StarCacheReader> open(
+                const std::string& cache_path,
+                const std::vector<std::string>& source_paths,
+                const std::optional<double>& epoch,
+                const uint32_t dec_bands = 0
+        );
+
+        std::size_t rows() const noexcept;
+
+        std::size_t skipped_rows() const noexcept;
+
+        /// Skipped rows of the main catalog, one bit per data row
+        const RowBitmap& skipped_catalog_rows() const noexcept;
+
+        /// Zone maps, one per CACHE_ZONE_ROWS rows
+        const std::vector<ZoneMap>& zones() const noexcept;
+
+        /// Number of zones passed over by the filtered read_block()
+        std::size_t skipped_zones() const noexcept;
+
+        /**
+         * \brief   Reads the next block of at most max_rows stars.
+         *
+         * \return  false when all rows have been read
+         * \throw   std::runtime_error if the file is truncated
+         */
+        bool read_block(
+                StarColumns& block,
+                const std::size_t max_rows
+        );
+
+        /**
+         * \brief   Reads the next zone that may hold stars passing the filter.
+         *
+         * Zones that can not match are skipped unread. The block may still
+         * contain stars the filter rejects. Do not mix with the max_rows
+         * overload, which does not keep reads aligned to zones.
+         *
+         * \return  false when no further zone can match
+         * \throw   std::runtime_error if the file is truncated
+         */
+        bool read_block(
+                StarColumns& block,
+                const StarFilter& filter
+        );
+
+    private:
+        StarCacheReader(
+                    std::ifstream&& file,
+                    const std::size_t rows,
+                    const std::size_t skipped_rows,
+                    RowBitmap&& skipped_catalog_rows,
+                    std::vector<ZoneMap>&& zones
+        );
+
+        std::ifstream file;
+        std::size_t total_rows;
+        std::size_t total_skipped_rows;
+        RowBitmap catalog_skips;
+        std::size_t position;
+        std::vector<ZoneMap> zone_maps;
+        std::size_t zones_skipped;
+};
+
+
+/**
+ * \brief   Writes a cache file from blocks of stars, in constant memory.
+ *
+ * Columns are spooled to temporary files and joined by finish(), so the
+ * full table never has to be materialized. finish() also computes the zone
+ * maps. The temporary files are private to the writer, so processes caching
+ * the same catalog at once do not mix their rows; the last one to finish
+ * replaces the cache file.
+ *
+ * With Dec bands, rows are spooled per band of declination and the bands are
+ * joined from south to north. Every zone then covers a narrow strip of the
+ * sky, so filtered reads of a declination range skip most of the file.
+ * Within a band, rows keep their order.
+ */
+class StarCacheWriter {
+    public:
+        /**
+         * \param   dec_bands   number of equal declination bands to sort rows into; zero keeps the input order
+         */
+        StarCacheWriter(
+                    const std::string& cache_path,
+                    const std::vector<std::string>& source_paths,
+                    const std::optional<double>& epoch,
+                    const uint32_t dec_bands = 0
+        );
+
+        ~StarCacheWriter();
+
+        StarCacheWriter(const StarCacheWriter&) = delete;
+        StarCacheWriter& operator=(const StarCacheWriter&) = delete;
+
+        void append(const StarColumns& block);
+
+        /**
+         * \brief   Writes the cache file.
+         *
+         * \param   skipped_rows            skipped rows of all source files
+         * \param   skipped_catalog_rows    which rows of the main catalog were skipped
+         * \throw   std::runtime_error if the file can not be written
+         */
+        void finish(
+                const std::size_t skipped_rows,
+                const RowBitmap& skipped_catalog_rows
+        );
+
+    private:
+        /**
+         * \brief   Temporary column files of one declination band.
+         */
+        struct Spool {
+            std::ofstream ra_file;
+            std::ofstream de_file;
+            std::ofstream mag_file;
+            std::ofstream sources_file;
+            bool opened = false;
+        };
+
+        std::string spool_path(
+                const std::size_t band,
+                const char* column
+        ) const;
+
+        void write_spool(
+                const std::size_t band,
+                const StarColumns& block
+        );
+
+        const std::string cache_path;
+        /// Prefix of the temporary files, unique to this writer
+        const std::string tmp_path;
+        const std::vector<std::string> source_paths;
+        const std::optional<double> epoch;
+        const uint32_t dec_bands;
+        std::vector<Spool> spools;
+        std::vector<StarColumns> band_blocks;
+        std::size_t rows;
+        bool finished;
+};
+
+
+/**
+ * \brief   Loads a cached star table in full, or the zones of it that may pass a filter.
+ *
+ * \param   filter  if set, zones that can not match are left out
+ * \return  nothing if the cache is missing or out of date, see StarCacheReader::open()
+ */
+std::optional<StarCache> load_star_cache(
+        const std::string& cache_path,
+        const std::vector<std::string>& source_paths,
+        const std::optional<double>& epoch,
+        const uint32_t dec_bands = 0,
+        const StarFilter* filter = nullptr
+);
+
+
+/**
+ * \brief   Stores the star table in a cache file.
+ *
+ * \throw   std::runtime_error if the file can not be written
+ */
+void save_star_cache(
+        const std::string& cache_path,
+        const std::vector<std::string>& source_paths,
+        const std::optional<double>& epoch,
+        const StarCache& cache,
+        const uint32_t dec_bands = 0
+);
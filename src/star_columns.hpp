@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/**
+ * \brief   Structure-of-arrays star table: one contiguous column per quantity.
+ *
+ * Batch transforms walk these columns with unit stride, so they can be
+ * vectorized by the compiler.
+ */
+struct StarColumns {
+    std::vector<double> ra_deg;
+    std::vector<double> de_deg;
+    std::vector<double> mag;
+    /// Bit i is set if magnitude column i of the catalog format held a value
+    std::vector<uint8_t> mag_sources;
+
+    std::size_t size() const noexcept {
+        return mag.size();
+    }
+
+    void reserve(const std::size_t count) {
+        ra_deg.reserve(count);
+        de_deg.reserve(count);
+        mag.reserve(count);
+        mag_sources.reserve(count);
+    }
+
+    void resize(const std::size_t count) {
+        ra_deg.resize(count);
+        de_deg.resize(count);
+        mag.resize(count);
+        mag_sources.resize(count);
+    }
+
+    void push_back(
+                const double ra,
+                const double de,
+                const double m,
+                const uint8_t sources
+    ) {
+        ra_deg.push_back(ra);
+        de_deg.push_back(de);
+        mag.push_back(m);
+        mag_sources.push_back(sources);
+    }
+
+    void clear() noexcept {
+        ra_deg.clear();
+        de_deg.clear();
+        mag.clear();
+        mag_sources.clear();
+    }
+
+    void append(const StarColumns& other) {
+        ra_deg.insert(ra_deg.end(), other.ra_deg.cbegin(), other.ra_deg.cend());
+        de_deg.insert(de_deg.end(), other.de_deg.cbegin(), other.de_deg.cend());
+        mag.insert(mag.end(), other.mag.cbegin(), other.mag.cend());
+        mag_sources.insert(mag_sources.end(), other.mag_sources.cbegin(), other.mag_sources.cend());
+    }
+};
+
+
+/**
+ * \brief   Read-only columns of a star table held elsewhere, e.g. in a shared memory segment.
+ */
+struct StarColumnsView {
+    const double* ra_deg = nullptr;
+    const double* de_deg = nullptr;
+    const double* mag = nullptr;
+    const uint8_t* mag_sources = nullptr;
+    std::size_t rows = 0;
+
+    StarColumnsView() = default;
+
+    StarColumnsView(
+                const double* ra_deg,
+                const double* de_deg,
+                const double* mag,
+                const uint8_t* mag_sources,
+                const std::size_t rows
+    ) noexcept:
+            ra_deg(ra_deg),
+            de_deg(de_deg),
+            mag(mag),
+            mag_sources(mag_sources),
+            rows(rows)
+    {}
+
+    StarColumnsView(const StarColumns& columns) noexcept:
+            StarColumnsView(
+                columns.ra_deg.data(),
+                columns.de_deg.data(),
+                columns.mag.data(),
+                columns.mag_sources.data(),
+                columns.size()
+            )
+    {}
+
+    std::size_t size() const noexcept {
+        return rows;
+    }
+};
+
+
+/**
+ * \brief   Mean catalog positions and proper motions, stored column-wise.
+ *
+ * Proper motion in RA already includes the cos(Dec) factor, as in Tycho-2.
+ */
+struct MeanPositionColumns {
+    std::vector<double> ra_deg;
+    std::vector<double> de_deg;
+    std::vector<double> pm_ra_mas;
+    std::vector<double> pm_de_mas;
+    std::vector<double> mag;
+    /// Bit i is set if magnitude column i of the catalog format held a value
+    std::vector<uint8_t> mag_sources;
+
+    std::size_t size() const noexcept {
+        return mag.size();
+    }
+
+    void reserve(const std::size_t count) {
+        ra_deg.reserve(count);
+        de_deg.reserve(count);
+        pm_ra_mas.reserve(count);
+        pm_de_mas.reserve(count);
+        mag.reserve(count);
+        mag_sources.reserve(count);
+    }
+
+    void push_back(
+                const double ra,
+                const double de,
+                const double pm_ra,
+                const double pm_de,
+                const double m,
+                const uint8_t sources
+    ) {
+        ra_deg.push_back(ra);
+        de_deg.push_back(de);
+        pm_ra_mas.push_back(pm_ra);
+        pm_de_mas.push_back(pm_de);
+        mag.push_back(m);
+        mag_sources.push_back(sources);
+    }
+
+    void clear() noexcept {
+        ra_deg.clear();
+        de_deg.clear();
+        pm_ra_mas.clear();
+        pm_de_mas.clear();
+        mag.clear();
+        mag_sources.clear();
+    }
+
+    void append(const MeanPositionColumns& other) {
+        ra_deg.insert(ra_deg.end(), other.ra_deg.cbegin(), other.ra_deg.cend());
+        de_deg.insert(de_deg.end(), other.de_deg.cbegin(), other.de_deg.cend());
+        pm_ra_mas.insert(pm_ra_mas.end(), other.pm_ra_mas.cbegin(), other.pm_ra_mas.cend());
+        pm_de_mas.insert(pm_de_mas.end(), other.pm_de_mas.cbegin(), other.pm_de_mas.cend());
+        mag.insert(mag.end(), other.mag.cbegin(), other.mag.cend());
+        mag_sources.insert(mag_sources.end(), other.mag_sources.cbegin(), other.mag_sources.cend());
+    }
+};
+
+
+/**
+ * \brief   Unit direction vectors of stars, stored column-wise.
+ */
+struct UnitVectorColumns {
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> z;
+
+    std::size_t size() const noexcept {
+        return x.size();
+    }
+
+    void resize(const std::size_t count) {
+        x.resize(count);
+        y.resize(count);
+        z.resize(count);
+    }
+};
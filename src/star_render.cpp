@@ -0,0 +1,258 @@
+#include "star_render.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <boost/format.hpp>
+
+
+namespace {
+
+/// Stars projected at a time in catalog order
+constexpr std::size_t CATALOG_ORDER_BLOCK = 4096;
+
+constexpr std::pair<int, const char*> DEPTH_NAMES[] = {
+    {CV_8U, "8"},
+    {CV_16U, "16"},
+    {CV_32F, "float"},
+};
+
+/// Pixel value of full brightness
+template <typename Pixel>
+constexpr double FULL_SCALE = std::numeric_limits<Pixel>::max();
+
+template <>
+constexpr double FULL_SCALE<float> = 1;
+
+}
+
+
+template <typename Pixel>
+StarRasterizer<Pixel>::StarRasterizer(
+            cv::Mat& img,
+            const double min_ra,
+            const double max_ra,
+            const double min_dec,
+            const double max_dec,
+            const double min_mag,
+            const double max_mag
+):
+        img(img),
+        width(img.cols),
+        height(img.rows),
+        min_ra(min_ra),
+        min_dec(min_dec),
+        ra_range(max_ra - min_ra),
+        dec_range(max_dec - min_dec),
+        max_mag(max_mag),
+        mag_range(max_mag - min_mag)
+{}
+
+
+template <typename Pixel>
+bool StarRasterizer<Pixel>::plot(
+        const double ra,
+        const double de,
+        const double mag
+) {
+    uint32_t x, y;
+    if (!pixel(ra, de, x, y))
+        return false;
+
+    plot_pixel(x, y, brightness(mag));
+    return true;
+}
+
+
+template <typename Pixel>
+bool StarRasterizer<Pixel>::pixel(
+        const double ra,
+        const double de,
+        uint32_t& x,
+        uint32_t& y
+) const noexcept {
+    x = (ra - min_ra) / ra_range * width;
+    y = (de - min_dec) / dec_range * height;
+    return x < width && y < height;
+}
+
+
+template <typename Pixel>
+Pixel StarRasterizer<Pixel>::brightness(const double mag) const noexcept {
+    if (!(mag_range > 0))
+        return FULL_SCALE<Pixel>;
+
+    // Inverse the magnitude scale (brighter stars have lower magnitudes); stars
+    // brighter than the minimum magnitude saturate rather than overflow the pixel
+    const auto normalized_mag = std::clamp((max_mag - mag) / mag_range, 0.0, 1.0);
+
+    // Apply a non-linear scaling to emphasize brighter stars
+    return std::pow(normalized_mag, 2.5) * FULL_SCALE<Pixel>;
+}
+
+
+template <typename Pixel>
+void StarRasterizer<Pixel>::plot_pixel(
+        const uint32_t x,
+        const uint32_t y,
+        const Pixel brightness
+) {
+    cv::circle(
+        img,
+        cv::Point(x, y),
+        0,
+        cv::Scalar(brightness)
+    );
+}
+
+
+template class StarRasterizer<uint8_t>;
+template class StarRasterizer<uint16_t>;
+template class StarRasterizer<float>;
+
+
+namespace {
+
+template <typename Pixel>
+MagnitudeScale render_stars_as(
+        const std::vector<Star>& stars,
+        const StarOrder order,
+        const uint32_t width,
+        const uint32_t height,
+        const double min_ra,
+        const double max_ra,
+        const double min_dec,
+        const double max_dec,
+        const std::optional<double>& min_magnitude,
+        cv::OutputArray dst,
+        Metrics* metrics
+) {
+    StageTimer clear_timer(metrics, Stage::rasterize);
+    dst.create(height, width, CV_MAKETYPE(cv::DataType<Pixel>::depth, 1));
+    cv::Mat img = dst.getMat();
+    img.setTo(cv::Scalar(0));
+    clear_timer.stop();
+    if (stars.empty()) {
+        constexpr auto unknown = std::numeric_limits<double>::quiet_NaN();
+        return MagnitudeScale{min_magnitude.value_or(unknown), unknown};
+    }
+
+    // Find the minimum and maximum magnitudes in the dataset
+    StageTimer minmax_timer(metrics, Stage::minmax);
+    const auto [min_mag_star, max_mag_star] = std::minmax_element(
+        stars.cbegin(),
+        stars.cend(),
+        [] (const Star& a, const Star& b) {
+            return (a.mag < b.mag);
+        }
+    );
+    const auto min_mag = min_magnitude.value_or(min_mag_star->mag);
+    const auto max_mag = max_mag_star->mag;
+    minmax_timer.stop();
+
+    struct Dot {
+        uint64_t index;
+        uint32_t x;
+        uint32_t y;
+        Pixel brightness;
+    };
+
+    // In catalog order, stars are projected and plotted a block at a time, so
+    // the dots stay in the L1 cache; along a curve, all of them are sorted
+    const std::size_t block_size = order == StarOrder::catalog ? CATALOG_ORDER_BLOCK : stars.size();
+    StarRasterizer<Pixel> rasterizer(img, min_ra, max_ra, min_dec, max_dec, min_mag, max_mag);
+    const auto bits = curve_bits(width, height);
+    std::vector<Dot> dots;
+    dots.reserve(std::min(block_size, stars.size()));
+    std::size_t plotted = 0;
+    for (std::size_t first = 0; first < stars.size(); first += block_size) {
+        const auto last = std::min(first + block_size, stars.size());
+
+        StageTimer project_timer(metrics, Stage::project);
+        dots.clear();
+        for (std::size_t i = first; i < last; i++) {
+            const auto& star = stars[i];
+            uint32_t x, y;
+            if (rasterizer.pixel(star.ra_deg, star.de_deg, x, y)) {
+                const uint64_t index = order == StarOrder::catalog ? 0 : curve_index(order, x, y, bits);
+                dots.push_back(Dot{index, x, y, rasterizer.brightness(star.mag)});
+            }
+        }
+        if (order != StarOrder::catalog)
+            std::stable_sort(
+                dots.begin(),
+                dots.end(),
+                [] (const Dot& a, const Dot& b) {
+                    return a.index < b.index;
+                }
+            );
+        project_timer.stop();
+
+        StageTimer rasterize_timer(metrics, Stage::rasterize);
+        for (const auto& dot : dots)
+            rasterizer.plot_pixel(dot.x, dot.y, dot.brightness);
+        plotted += dots.size();
+    }
+
+    if (metrics) {
+        metrics->add_count(Counter::stars_plotted, plotted);
+        metrics->add_count(Counter::stars_clipped, stars.size() - plotted);
+    }
+
+    return MagnitudeScale{min_mag, max_mag};
+}
+
+}
+
+
+int pixel_depth(const std::string& name) {
+    for (const auto& [depth, depth_name] : DEPTH_NAMES)
+        if (name == depth_name)
+            return depth;
+
+    throw std::runtime_error(
+        (
+            boost::format("Unknown pixel depth: %1%") % name
+        ).str()
+    );
+}
+
+
+const char* pixel_depth_name(const int depth) noexcept {
+    for (const auto& [d, name] : DEPTH_NAMES)
+        if (d == depth)
+            return name;
+    return "unknown";
+}
+
+
+std::vector<std::string> pixel_depth_names() {
+    std::vector<std::string> names;
+    for (const auto& [depth, name] : DEPTH_NAMES)
+        names.push_back(name);
+    return names;
+}
+
+
+MagnitudeScale render_stars(
+        const std::vector<Star>& stars,
+        const StarOrder order,
+        const uint32_t width,
+        const uint32_t height,
+        const double min_ra,
+        const double max_ra,
+        const double min_dec,
+        const double max_dec,
+        const std::optional<double>& min_magnitude,
+        const int depth,
+        cv::OutputArray dst,
+        Metrics* metrics
+) {
+    return visit_pixel_type(
+        depth,
+        [&] (auto pixel) {
+            return render_stars_as<decltype(pixel)>(stars, order, width, height, min_ra, max_ra, min_dec, max_dec, min_magnitude, dst, metrics);
+        }
+    );
+}
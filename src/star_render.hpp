@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "curve_order.hpp"
+#include "metrics.hpp"
+#include "star.hpp"
+
+
+/**
+ * \brief   Plots stars into a grayscale image, mapping the RA/Dec window linearly onto it.
+ *
+ * \tparam  Pixel   uint8_t, uint16_t or float; full brightness is the largest
+ *                  integer, or 1 for float
+ */
+template <typename Pixel>
+class StarRasterizer {
+    public:
+        StarRasterizer(
+                    cv::Mat& img,
+                    const double min_ra,
+                    const double max_ra,
+                    const double min_dec,
+                    const double max_dec,
+                    const double min_mag,
+                    const double max_mag
+        );
+
+        /**
+         * \return  false if the star falls outside the image
+         */
+        bool plot(
+                const double ra,
+                const double de,
+                const double mag
+        );
+
+        /**
+         * \brief   Finds the pixel a star is plotted on.
+         *
+         * \return  false if the star falls outside the image
+         */
+        bool pixel(
+                const double ra,
+                const double de,
+                uint32_t& x,
+                uint32_t& y
+        ) const noexcept;
+
+        /**
+         * \return  full scale at the minimum magnitude or brighter, zero at the maximum or fainter
+         */
+        Pixel brightness(const double mag) const noexcept;
+
+        /**
+         * \brief   Plots a star on a pixel found by pixel().
+         */
+        void plot_pixel(
+                const uint32_t x,
+                const uint32_t y,
+                const Pixel brightness
+        );
+
+    private:
+        cv::Mat& img;
+        const uint32_t width;
+        const uint32_t height;
+        const double min_ra;
+        const double min_dec;
+        const double ra_range;
+        const double dec_range;
+        const double max_mag;
+        const double mag_range;
+};
+
+extern template class StarRasterizer<uint8_t>;
+extern template class StarRasterizer<uint16_t>;
+extern template class StarRasterizer<float>;
+
+
+/**
+ * \brief   Calls f with a value of the pixel type of an OpenCV depth.
+ *
+ * \param   depth   CV_8U, CV_16U or CV_32F
+ * \throw   std::runtime_error for other depths
+ */
+template <typename Function>
+auto visit_pixel_type(
+        const int depth,
+        Function&& f
+) {
+    switch (depth) {
+        case CV_8U:
+            return f(uint8_t{});
+        case CV_16U:
+            return f(uint16_t{});
+        case CV_32F:
+            return f(float{});
+        default:
+            throw std::runtime_error("Images are 8-bit, 16-bit or float");
+    }
+}
+
+
+/**
+ * \throw   std::runtime_error for unknown names
+ * \return  the OpenCV depth
+ */
+int pixel_depth(const std::string& name);
+
+
+const char* pixel_depth_name(const int depth) noexcept;
+
+
+/**
+ * \return  names accepted by pixel_depth()
+ */
+std::vector<std::string> pixel_depth_names();
+
+
+/**
+ * \brief   Magnitudes rendered at full and at zero brightness.
+ */
+struct MagnitudeScale {
+    double min_mag;
+    double max_mag;
+};
+
+
+/**
+ * \brief   Plots stars in the given order.
+ *
+ * Along a space-filling curve, consecutive stars land on nearby pixels, which
+ * keeps large images in the CPU caches and TLB. Pixels are computed in
+ * catalog order and sorted together with the star's brightness, so the
+ * plotting pass reads memory sequentially too. Stars on one pixel keep their
+ * order, so the image is the same in every order.
+ *
+ * \param   min_magnitude   full brightness; the brightest star if not given
+ * \param   depth           of the image: CV_8U, CV_16U or CV_32F
+ * \param   metrics         if set, receives the minmax, project and rasterize times and
+ *                          the stars plotted and clipped
+ * \return  the magnitude scale of the image; NaN where there are no stars to take it from
+ */
+MagnitudeScale render_stars(
+        const std::vector<Star>& stars,
+        const StarOrder order,
+        const uint32_t width,
+        const uint32_t height,
+        const double min_ra,
+        const double max_ra,
+        const double min_dec,
+        const double max_dec,
+        const std::optional<double>& min_magnitude,
+        const int depth,
+        cv::OutputArray dst,
+        Metrics* metrics = nullptr
+);
@@ -0,0 +1,404 @@
+#include "star_source.hpp"
+
+#include <algorithm>
+#include <future>
+#include <limits>
+
+#include "epoch.hpp"
+#include "log.hpp"
+#include "star_render.hpp"
+
+
+namespace {
+
+/// Format of the files passed with --supplement
+constexpr char SUPPLEMENT_FORMAT[] = "tycho2-suppl";
+
+
+/**
+ * \brief   Starts reading every supplement file on its own thread.
+ */
+std::vector<std::future<std::vector<CatalogEntry>>> read_supplements_async(
+        const std::vector<std::string>& paths,
+        std::vector<std::size_t>& skipped_rows
+) {
+    skipped_rows.assign(paths.size(), 0);
+    std::vector<std::future<std::vector<CatalogEntry>>> futures;
+    for (std::size_t i = 0; i < paths.size(); i++)
+        futures.push_back(
+            std::async(
+                std::launch::async,
+                read_entries,
+                std::cref(paths[i]),
+                std::cref(catalog_format(SUPPLEMENT_FORMAT)),
+                std::ref(skipped_rows[i])
+            )
+        );
+    return futures;
+}
+
+
+/**
+ * \brief   Collects supplement stars, dropping those whose TYC or HIP identifier is in the main catalog.
+ */
+std::vector<CatalogEntry> merge_supplements(
+        std::vector<std::future<std::vector<CatalogEntry>>>& futures,
+        const CatalogIds& ids
+) {
+    std::vector<CatalogEntry> merged;
+    std::size_t duplicates = 0;
+    for (auto& future : futures) {
+        for (const auto& entry : future.get()) {
+            if (
+                    (entry.tyc && ids.tyc.count(*entry.tyc) != 0)
+                    ||
+                    (entry.hip && ids.hip.count(*entry.hip) != 0)
+            ) {
+                duplicates++;
+                continue;
+            }
+            merged.push_back(entry);
+        }
+    }
+
+    log_info("Supplement stars merged: %1%", merged.size());
+    log_info("Supplement duplicates of main-catalog stars dropped: %1%", duplicates);
+
+    return merged;
+}
+
+}
+
+
+std::vector<Star> filter_stars(
+        const StarColumnsView& columns,
+        const StarFilter& filter,
+        const ZoneMap* zones
+) {
+    std::vector<Star> stars;
+    for (std::size_t begin = 0; begin < columns.size(); begin += CACHE_ZONE_ROWS) {
+        if (zones && !zones[begin / CACHE_ZONE_ROWS].may_match(filter))
+            continue;
+        const auto end = std::min(begin + CACHE_ZONE_ROWS, columns.size());
+        for (std::size_t i = begin; i < end; i++) {
+            const auto ra = columns.ra_deg[i];
+            const auto dec = columns.de_deg[i];
+            const auto mag = columns.mag[i];
+            if (filter.accepts(ra, dec, mag))
+                stars.emplace_back(ra, dec, mag);
+        }
+    }
+    return stars;
+}
+
+
+StarBlockSource::StarBlockSource(
+            const std::string& path,
+            const CatalogFormat& format,
+            const std::vector<std::string>& supplement_paths,
+            const std::optional<double>& epoch,
+            const std::optional<std::string>& cache_path,
+            const uint32_t dec_bands,
+            const PipelineOptions& pipeline_options,
+            Metrics* metrics
+):
+        path(path),
+        format(format),
+        supplement_paths(supplement_paths),
+        epoch(epoch),
+        cache_path(cache_path),
+        dec_bands(dec_bands),
+        pipeline_options(pipeline_options),
+        metrics(metrics),
+        source_paths{path}
+{
+    source_paths.insert(source_paths.end(), supplement_paths.cbegin(), supplement_paths.cend());
+}
+
+
+StarBlockSource::StarBlockSource(
+            const CatalogOptions& options,
+            Metrics* metrics
+):
+        StarBlockSource(
+            options.path,
+            catalog_format(options.format),
+            options.supplement_paths,
+            options.epoch,
+            options.cache_dir
+                ? std::optional<std::string>(star_cache_path(*options.cache_dir, options.path, catalog_format(options.format).name, options.epoch, options.cache_dec_bands))
+                : std::nullopt,
+            options.cache_dec_bands,
+            options.pipeline,
+            metrics
+        )
+{}
+
+
+std::size_t StarBlockSource::for_each_block(
+        const std::function<void(const StarColumns&)>& consume,
+        const StarFilter* filter
+) {
+    if (cache_path) {
+        StageTimer open_timer(metrics, Stage::open);
+        auto reader = StarCacheReader::open(*cache_path, source_paths, epoch, dec_bands);
+        open_timer.stop();
+        if (reader) {
+            log_info("Streaming %1% stars from cache: %2%", reader->rows(), *cache_path);
+            StarColumns block;
+            const auto next_block = [&] {
+                const StageTimer timer(metrics, Stage::parse);
+                return filter ? reader->read_block(block, *filter) : reader->read_block(block, STAR_BLOCK_ROWS);
+            };
+            while (next_block()) {
+                if (metrics)
+                    metrics->add_count(Counter::rows, block.size());
+                consume(block);
+            }
+            if (filter)
+                log_info("Skipped %1% of %2% cache blocks outside the query", reader->skipped_zones(), reader->zones().size());
+            catalog_skips = reader->skipped_catalog_rows();
+            if (pushdown)
+                pushdown->rejected_rows = RowBitmap();
+            return reader->skipped_rows();
+        }
+    }
+
+    return parse_catalog(consume);
+}
+
+
+const RowBitmap& StarBlockSource::skipped_catalog_rows() const noexcept {
+    return catalog_skips;
+}
+
+
+void StarBlockSource::push_down(const StarFilter& filter) {
+    if (cache_path || epoch)
+        return;
+    pushdown.emplace();
+    pushdown->filter = filter;
+}
+
+
+const RowBitmap& StarBlockSource::rejected_catalog_rows() const noexcept {
+    static const RowBitmap none;
+    return pushdown ? pushdown->rejected_rows : none;
+}
+
+
+std::size_t StarBlockSource::parse_catalog(const std::function<void(const StarColumns&)>& consume) {
+    std::optional<StarCacheWriter> writer;
+    if (cache_path)
+        writer.emplace(*cache_path, source_paths, epoch, dec_bands);
+
+    const auto emit = [&writer, &consume] (const StarColumns& block) {
+        if (writer)
+            writer->append(block);
+        consume(block);
+    };
+
+    std::vector<std::size_t> supplement_skipped_rows;
+    auto supplement_futures = read_supplements_async(supplement_paths, supplement_skipped_rows);
+
+    CatalogIds ids;
+    CatalogIds* const ids_ptr = supplement_paths.empty() ? nullptr : &ids;
+    auto skipped_rows = pipeline_star_blocks(
+        path,
+        format,
+        epoch,
+        pipeline_options,
+        emit,
+        ids_ptr,
+        &catalog_skips,
+        pushdown ? &*pushdown : nullptr,
+        metrics
+    );
+    if (pushdown)
+        pushdown->counters.report();
+
+    if (!supplement_paths.empty()) {
+        const auto supplements = merge_supplements(supplement_futures, ids);
+        for (const auto skipped : supplement_skipped_rows)
+            skipped_rows += skipped;
+
+        StarColumns block;
+        if (epoch) {
+            MeanPositionColumns positions;
+            for (const auto& entry : supplements)
+                positions.push_back(entry.mean_ra_deg, entry.mean_de_deg, entry.pm_ra_mas, entry.pm_de_mas, entry.mag, entry.mag_sources);
+            propagate_epoch(positions, catalog_format(SUPPLEMENT_FORMAT).astrometry.value().epoch, *epoch, block);
+        } else {
+            for (const auto& entry : supplements)
+                block.push_back(entry.ra_deg, entry.de_deg, entry.mag, entry.mag_sources);
+        }
+        emit(block);
+    }
+
+    if (writer) {
+        try {
+            writer->finish(skipped_rows, catalog_skips);
+            log_info("Saved cache: %1%", *cache_path);
+        }
+        catch (const std::runtime_error& e) {
+            log_error("Failed to save cache: %1%", e.what());
+        }
+    }
+
+    return skipped_rows;
+}
+
+
+StarCache load_stars(
+        StarBlockSource& source,
+        const StarFilter* filter
+) {
+    StarCache cache;
+    cache.skipped_rows = source.for_each_block(
+        [&cache] (const StarColumns& block) {
+            cache.columns.append(block);
+        },
+        filter
+    );
+    cache.skipped_catalog_rows = source.skipped_catalog_rows();
+    return cache;
+}
+
+
+std::vector<Star> read_stars_with_supplements(
+        StarBlockSource& source,
+        const bool with_supplements,
+        const StarFilter& filter,
+        Metrics* metrics
+) {
+    std::vector<Star> stars;
+    std::vector<std::size_t> source_rows;
+    std::size_t row = 0;
+    const auto skipped_rows = source.for_each_block(
+        [&] (const StarColumns& block) {
+            const StageTimer timer(metrics, Stage::filter);
+            for (std::size_t i = 0; i < block.size(); i++) {
+                if (filter.accepts(block.ra_deg[i], block.de_deg[i], block.mag[i])) {
+                    stars.emplace_back(block.ra_deg[i], block.de_deg[i], block.mag[i]);
+                    source_rows.push_back(row + i);
+                }
+            }
+            row += block.size();
+        }
+    );
+
+    // Walk the catalog rows, counting the ones that made it into the source
+    const auto& skipped = source.skipped_catalog_rows();
+    const auto& rejected = source.rejected_catalog_rows();
+    std::size_t catalog_stars = 0;
+    row = 0;
+    for (std::size_t catalog_row = 0; catalog_row < skipped.size() && catalog_stars < stars.size(); catalog_row++) {
+        if (skipped.test(catalog_row) || rejected.test(catalog_row))
+            continue;
+        if (source_rows[catalog_stars] == row) {
+            const auto& star = stars[catalog_stars];
+            if (log_progress_row(catalog_row))
+                log_progress("Star %1%: RA=%2%, Dec=%3%, Mag=%4%", catalog_row, star.ra_deg, star.de_deg, star.mag);
+            catalog_stars++;
+        }
+        row++;
+    }
+
+    log_info("Total stars read and filtered: %1%", catalog_stars);
+    log_info("Total rows skipped: %1%", skipped.count());
+    if (with_supplements) {
+        log_info("Supplement stars read and filtered: %1%", stars.size() - catalog_stars);
+        log_info("Supplement rows skipped: %1%", skipped_rows - skipped.count());
+    }
+    if (metrics)
+        metrics->add_count(Counter::skipped_rows, skipped_rows);
+
+    return stars;
+}
+
+
+void stream_render(
+        StarBlockSource& source,
+        const StarFilter& filter,
+        const std::optional<ApparentTransform>& apparent,
+        const std::optional<double>& min_magnitude,
+        const uint32_t display_count,
+        const uint32_t width,
+        const uint32_t height,
+        const int depth,
+        cv::OutputArray dst,
+        Metrics* metrics
+) {
+    StarColumns apparent_block;
+    const auto transform = [&apparent, &apparent_block] (const StarColumns& block) -> const StarColumns& {
+        if (!apparent)
+            return block;
+        apparent_block = block;
+        apply_apparent_place(*apparent, apparent_block);
+        return apparent_block;
+    };
+    // Zone maps hold cached positions, which apparent places move
+    const StarFilter* const zone_filter = apparent ? nullptr : &filter;
+
+    double min_mag;
+    if (min_magnitude) {
+        min_mag = *min_magnitude;
+    } else {
+        min_mag = std::numeric_limits<double>::infinity();
+        source.for_each_block(
+            [&transform, &filter, &min_mag, metrics] (const StarColumns& block) {
+                const StageTimer timer(metrics, Stage::minmax);
+                const auto& stars = transform(block);
+                for (std::size_t i = 0; i < stars.size(); i++)
+                    if (filter.accepts(stars.ra_deg[i], stars.de_deg[i], stars.mag[i]))
+                        min_mag = std::min(min_mag, stars.mag[i]);
+            },
+            zone_filter
+        );
+    }
+    const auto max_mag = filter.max_magnitude;
+
+    log_info("Magnitude range: %1$.3f to %2$.3f", min_mag, max_mag);
+
+    dst.create(height, width, CV_MAKETYPE(depth, 1));
+    cv::Mat img = dst.getMat();
+    img.setTo(cv::Scalar(0));
+
+    log_progress("First %1% stars:", display_count);
+    std::size_t accepted = 0;
+    std::size_t plotted = 0;
+    const auto skipped_rows = visit_pixel_type(
+        depth,
+        [&] (auto pixel) {
+            StarRasterizer<decltype(pixel)> rasterizer(img, filter.min_ra, filter.max_ra, filter.min_dec, filter.max_dec, min_mag, max_mag);
+            return source.for_each_block(
+                [&] (const StarColumns& block) {
+                    const StageTimer timer(metrics, Stage::rasterize);
+                    const auto& stars = transform(block);
+                    for (std::size_t i = 0; i < stars.size(); i++) {
+                        const auto ra = stars.ra_deg[i];
+                        const auto dec = stars.de_deg[i];
+                        const auto mag = stars.mag[i];
+                        if (!filter.accepts(ra, dec, mag))
+                            continue;
+                        if (accepted < display_count || display_count == 0)
+                            log_progress("Star %1%: RA=%2$.2f, Dec=%3$.2f, Mag=%4$.2f", accepted, ra, dec, mag);
+                        if (rasterizer.plot(ra, dec, mag))
+                            plotted++;
+                        accepted++;
+                    }
+                },
+                zone_filter
+            );
+        }
+    );
+
+    log_info("Total stars read, filtered and rendered: %1%", accepted);
+    log_info("Total rows skipped: %1%", skipped_rows);
+
+    if (metrics) {
+        metrics->add_count(Counter::skipped_rows, skipped_rows);
+        metrics->add_count(Counter::stars_plotted, plotted);
+        metrics->add_count(Counter::stars_clipped, accepted - plotted);
+    }
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "apparent.hpp"
+#include "catalog.hpp"
+#include "metrics.hpp"
+#include "pipeline.hpp"
+#include "row_bitmap.hpp"
+#include "star.hpp"
+#include "star_cache.hpp"
+#include "star_columns.hpp"
+
+
+/**
+ * \brief   Catalog files stars are read from, and how.
+ */
+struct CatalogOptions {
+    std::string path;
+    /// Name accepted by catalog_format()
+    std::string format = "tycho2";
+    /// Tycho-2 supplement files merged into the catalog
+    std::vector<std::string> supplement_paths;
+    /// Julian epoch the mean positions are propagated to; the observed positions if not set
+    std::optional<double> epoch;
+    /// Directory of the column cache, empty for next to the catalog; no cache if not set
+    std::optional<std::string> cache_dir = std::string();
+    /// Declination bands of the cache rows, see StarCacheWriter
+    uint32_t cache_dec_bands = 0;
+    PipelineOptions pipeline;
+};
+
+
+/**
+ * \brief   Streams star blocks from the column cache if it is up to date, or from the catalog files otherwise.
+ *
+ * The catalog is parsed on the read/parse pipeline while the caller consumes
+ * the blocks. Parsing also writes the column cache, so a second pass (or the
+ * next run) reads the compact columns instead. Memory use does not depend on
+ * the catalog size.
+ */
+class StarBlockSource {
+    public:
+        StarBlockSource(
+                    const std::string& path,
+                    const CatalogFormat& format,
+                    const std::vector<std::string>& supplement_paths,
+                    const std::optional<double>& epoch,
+                    const std::optional<std::string>& cache_path,
+                    const uint32_t dec_bands,
+                    const PipelineOptions& pipeline_options,
+                    Metrics* metrics = nullptr
+        );
+
+        /**
+         * \throw   std::runtime_error for unknown catalog formats
+         */
+        explicit StarBlockSource(
+                    const CatalogOptions& options,
+                    Metrics* metrics = nullptr
+        );
+
+        /**
+         * \param   filter  if set, cache zones that can not match are skipped;
+         *                  blocks may still contain stars the filter rejects
+         * \return  number of skipped catalog rows
+         */
+        std::size_t for_each_block(
+                const std::function<void(const StarColumns&)>& consume,
+                const StarFilter* filter = nullptr
+        );
+
+        /**
+         * \brief   Skipped rows of the main catalog in the last for_each_block(), one bit per data row.
+         *
+         * Unfiltered blocks of an unbanded source hold the remaining rows in
+         * catalog order, followed by the supplement stars.
+         */
+        const RowBitmap& skipped_catalog_rows() const noexcept;
+
+        /**
+         * \brief   Drops stars the filter rejects while parsing, when the catalog is parsed without writing a cache.
+         *
+         * The cache has to hold every star, and epoch propagation moves the
+         * stars after parsing, so the filter only applies without either.
+         */
+        void push_down(const StarFilter& filter);
+
+        /**
+         * \brief   Catalog rows the pushed-down filter dropped in the last for_each_block(), one bit per data row.
+         *
+         * Empty when no filter was pushed down.
+         */
+        const RowBitmap& rejected_catalog_rows() const noexcept;
+
+    private:
+        std::size_t parse_catalog(const std::function<void(const StarColumns&)>& consume);
+
+        const std::string path;
+        const CatalogFormat& format;
+        const std::vector<std::string> supplement_paths;
+        const std::optional<double> epoch;
+        const std::optional<std::string> cache_path;
+        const uint32_t dec_bands;
+        const PipelineOptions pipeline_options;
+        Metrics* const metrics;
+        std::vector<std::string> source_paths;
+        RowBitmap catalog_skips;
+        std::optional<FilterPushdown> pushdown;
+};
+
+
+/**
+ * \brief   Selects the stars of a column table that fall into the window.
+ *
+ * \param   zones   if set, the zone maps of the table, one per CACHE_ZONE_ROWS
+ *                  rows; zones that can not match are passed over
+ */
+std::vector<Star> filter_stars(
+        const StarColumnsView& columns,
+        const StarFilter& filter,
+        const ZoneMap* zones = nullptr
+);
+
+
+/**
+ * \brief   Loads the whole star table of a source.
+ *
+ * \param   filter  if set, cache zones that can not match are not loaded
+ */
+StarCache load_stars(
+        StarBlockSource& source,
+        const StarFilter* filter = nullptr
+);
+
+
+/**
+ * \brief   Reads and filters stars of the main catalog and its supplements, reporting them like read_stars().
+ *
+ * The catalog row of every star is recovered from the skip bitmap (and the
+ * rows a pushed-down filter dropped), so the report is the same whether the
+ * stars were parsed or came from the cache.
+ *
+ * \param   source  unbanded source, see StarBlockSource::skipped_catalog_rows()
+ * \param   metrics if set, receives the filter time and the skipped rows
+ */
+std::vector<Star> read_stars_with_supplements(
+        StarBlockSource& source,
+        const bool with_supplements,
+        const StarFilter& filter,
+        Metrics* metrics = nullptr
+);
+
+
+/**
+ * \brief   Renders stars block by block as they are read, without materializing the star table.
+ *
+ * Brightness is normalized from min_magnitude (or, when not given, from a
+ * first pass over the source, which is cheap once the column cache exists) to
+ * the magnitude limit of the filter.
+ *
+ * \param   depth   of the image: CV_8U, CV_16U or CV_32F
+ * \param   metrics if set, receives the time of the first pass as minmax, and that of
+ *                  the second, which filters and plots the stars block by block, as
+ *                  rasterize
+ */
+void stream_render(
+        StarBlockSource& source,
+        const StarFilter& filter,
+        const std::optional<ApparentTransform>& apparent,
+        const std::optional<double>& min_magnitude,
+        const uint32_t display_count,
+        const uint32_t width,
+        const uint32_t height,
+        const int depth,
+        cv::OutputArray dst,
+        Metrics* metrics = nullptr
+);
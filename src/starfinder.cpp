@@ -0,0 +1,137 @@
+#include "starfinder.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+
+StarCatalog::StarCatalog(
+            StarCache cache,
+            const std::optional<double>& epoch
+):
+        cache(std::move(cache)),
+        target_epoch(epoch),
+        apparent_places(false)
+{}
+
+
+StarCatalog::StarCatalog(SharedStarTable shared):
+        shared(std::move(shared)),
+        target_epoch(this->shared->epoch()),
+        apparent_places(this->shared->apparent())
+{}
+
+
+StarCatalog StarCatalog::load(
+        const CatalogOptions& options,
+        const StarFilter* zone_filter,
+        Metrics* metrics
+) {
+    StarBlockSource source(options, metrics);
+    return StarCatalog(load_stars(source, zone_filter), options.epoch);
+}
+
+
+StarCatalog StarCatalog::attach(
+        const std::string& name,
+        Metrics* metrics
+) {
+    const StageTimer timer(metrics, Stage::open);
+    return StarCatalog(SharedStarTable::attach(name));
+}
+
+
+void StarCatalog::publish(const std::string& name) const {
+    SharedStarTable::publish(name, columns(), skipped_rows(), target_epoch, apparent_places);
+}
+
+
+std::size_t StarCatalog::size() const noexcept {
+    return columns().size();
+}
+
+
+std::size_t StarCatalog::skipped_rows() const noexcept {
+    return shared ? shared->skipped_rows() : cache.skipped_rows;
+}
+
+
+std::optional<double> StarCatalog::epoch() const noexcept {
+    return target_epoch;
+}
+
+
+bool StarCatalog::apparent() const noexcept {
+    return apparent_places;
+}
+
+
+void StarCatalog::apply_apparent_place(const ApparentTransform& transform) {
+    if (shared)
+        throw std::runtime_error("A shared catalog is read-only; apparent places are applied before publishing it");
+    ::apply_apparent_place(transform, cache.columns);
+    apparent_places = true;
+}
+
+
+std::vector<Star> StarCatalog::query(
+        const StarFilter& filter,
+        Metrics* metrics
+) const {
+    const StageTimer timer(metrics, Stage::filter);
+    return filter_stars(columns(), filter, shared ? shared->zones() : nullptr);
+}
+
+
+MagnitudeScale StarCatalog::render(
+        const StarFilter& filter,
+        const RenderOptions& options,
+        cv::Mat& dst,
+        Metrics* metrics
+) const {
+    if (dst.empty() || dst.channels() != 1)
+        throw std::runtime_error("Stars are rendered into a non-empty single channel image");
+
+    const auto stars = query(filter, metrics);
+    if (stars.empty()) {
+        // The image type is checked as render_stars() would
+        visit_pixel_type(dst.depth(), [] (auto) {});
+        dst.setTo(cv::Scalar(0));
+        return MagnitudeScale{options.min_magnitude.value_or(filter.max_magnitude), filter.max_magnitude};
+    }
+
+    // The size and type match, so render_stars() plots into dst's own pixels
+    return render_stars(
+        stars,
+        options.order,
+        dst.cols,
+        dst.rows,
+        filter.min_ra,
+        filter.max_ra,
+        filter.min_dec,
+        filter.max_dec,
+        options.min_magnitude,
+        dst.depth(),
+        dst,
+        metrics
+    );
+}
+
+
+MagnitudeScale StarCatalog::render(
+        const StarFilter& filter,
+        const RenderOptions& options,
+        const uint32_t width,
+        const uint32_t height,
+        const int depth,
+        void* pixels,
+        const std::size_t step,
+        Metrics* metrics
+) const {
+    cv::Mat dst(height, width, CV_MAKETYPE(depth, 1), pixels, step);
+    return render(filter, options, dst, metrics);
+}
+
+
+StarColumnsView StarCatalog::columns() const noexcept {
+    return shared ? shared->columns() : StarColumnsView(cache.columns);
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "apparent.hpp"
+#include "curve_order.hpp"
+#include "metrics.hpp"
+#include "shared_catalog.hpp"
+#include "star.hpp"
+#include "star_cache.hpp"
+#include "star_render.hpp"
+#include "star_source.hpp"
+
+
+/**
+ * \brief   How StarCatalog::render() maps stars onto pixels.
+ */
+struct RenderOptions {
+    StarOrder order = StarOrder::catalog;
+    /// Magnitude rendered at full brightness; the brightest star in the window if not set
+    std::optional<double> min_magnitude;
+};
+
+
+/**
+ * \brief   Star table of a catalog held in memory, to be queried and rendered many times.
+ *
+ * Loading reads the column cache when it is up to date, and parses the
+ * catalog (writing the cache) otherwise, like the render command. Queries and
+ * renders only read the table, so several may run at once.
+ *
+ * A loaded catalog can be published for other processes, which attach to it
+ * instead of loading the catalog themselves; see SharedStarTable.
+ */
+class StarCatalog {
+    public:
+        /**
+         * \param   zone_filter if set, only cache zones that can match it are loaded,
+         *                      so queries outside it miss stars
+         * \param   metrics     if set, receives the open, read and parse times
+         * \throw   std::runtime_error if the catalog can not be read
+         */
+        static StarCatalog load(
+                const CatalogOptions& options,
+                const StarFilter* zone_filter = nullptr,
+                Metrics* metrics = nullptr
+        );
+
+        /**
+         * \brief   Maps the star table another process published, read-only.
+         *
+         * \param   metrics if set, receives the time to map it as open
+         * \throw   std::runtime_error if the table is not published, see SharedStarTable::attach()
+         */
+        static StarCatalog attach(
+                const std::string& name,
+                Metrics* metrics = nullptr
+        );
+
+        /**
+         * \brief   Publishes the star table for other processes to attach to.
+         *
+         * \throw   std::runtime_error if the segment can not be created
+         */
+        void publish(const std::string& name) const;
+
+        std::size_t size() const noexcept;
+
+        /**
+         * \return  catalog rows that could not be parsed
+         */
+        std::size_t skipped_rows() const noexcept;
+
+        /**
+         * \return  epoch of the positions, or nothing for the observed positions
+         */
+        std::optional<double> epoch() const noexcept;
+
+        /**
+         * \return  whether the positions are apparent places
+         */
+        bool apparent() const noexcept;
+
+        /**
+         * \brief   Moves every star to its apparent place.
+         *
+         * \throw   std::runtime_error if the catalog is attached, and so read-only
+         */
+        void apply_apparent_place(const ApparentTransform& transform);
+
+        /**
+         * \return  the stars in the window, in catalog order
+         */
+        std::vector<Star> query(
+                const StarFilter& filter,
+                Metrics* metrics = nullptr
+        ) const;
+
+        /**
+         * \brief   Renders the stars in the window into an image the caller owns.
+         *
+         * dst is plotted in place and never reallocated, so it may be a header
+         * over the caller's own pixels; the window is mapped onto its size.
+         *
+         * \param   dst     one channel of CV_8U, CV_16U or CV_32F
+         * \throw   std::runtime_error if dst is empty or of another type
+         */
+        MagnitudeScale render(
+                const StarFilter& filter,
+                const RenderOptions& options,
+                cv::Mat& dst,
+                Metrics* metrics = nullptr
+        ) const;
+
+        /**
+         * \brief   Renders the stars in the window into a pixel buffer the caller owns.
+         *
+         * \param   depth   CV_8U, CV_16U or CV_32F
+         * \param   pixels  height rows, step bytes apart, of width pixels each
+         */
+        MagnitudeScale render(
+                const StarFilter& filter,
+                const RenderOptions& options,
+                const uint32_t width,
+                const uint32_t height,
+                const int depth,
+                void* pixels,
+                const std::size_t step,
+                Metrics* metrics = nullptr
+        ) const;
+
+    private:
+        StarCatalog(
+                    StarCache cache,
+                    const std::optional<double>& epoch
+        );
+
+        explicit StarCatalog(SharedStarTable shared);
+
+        StarColumnsView columns() const noexcept;
+
+        StarCache cache;
+        /// Set if the table is mapped from a shared segment rather than held in cache
+        std::optional<SharedStarTable> shared;
+        std::optional<double> target_epoch;
+        bool apparent_places;
+};
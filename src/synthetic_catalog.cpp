@@ -0,0 +1,294 @@
+#include "synthetic_catalog.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <boost/format.hpp>
+
+
+namespace {
+
+/// Rows formatted by one task of write_synthetic_catalog()
+constexpr std::size_t CHUNK_ROWS = 65536;
+
+/// Brightest V magnitude generated (Sirius is at -1.46)
+constexpr double MIN_MAGNITUDE = -1.5;
+
+/// Growth of star counts with magnitude, log10 per magnitude
+constexpr double COUNT_SLOPE = 0.45;
+
+/// Regions of the Guide Star Catalog, the first part of a TYC identifier
+constexpr uint64_t GSC_REGIONS = 9537;
+
+/// Rotation from galactic to ICRS coordinates (transpose of the ICRS to galactic matrix)
+constexpr double GALACTIC_TO_ICRS[3][3] = {
+    {-0.0548755604, 0.4941094279, -0.8676661490},
+    {-0.8734370902, -0.4448296300, -0.1980763734},
+    {-0.4838350155, 0.7469822445, 0.4559837762},
+};
+
+
+/**
+ * \brief   Small, fast generator seeded per row, so rows do not depend on each other.
+ */
+class SplitMix64 {
+    public:
+        explicit SplitMix64(const uint64_t seed) noexcept:
+                state(seed) {}
+
+        uint64_t next() noexcept {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        /// Uniform in [0, 1)
+        double uniform() noexcept {
+            return (next() >> 11) * 0x1.0p-53;
+        }
+
+        double uniform(
+                const double min,
+                const double max
+        ) noexcept {
+            return min + (max - min) * uniform();
+        }
+
+        /// Standard normal, by the Box-Muller transform
+        double normal() noexcept {
+            const double u = 1 - uniform();
+            return std::sqrt(-2 * std::log(u)) * std::cos(2 * M_PI * uniform());
+        }
+
+    private:
+        uint64_t state;
+};
+
+
+/**
+ * \brief   Sine of the galactic latitude: concentrated towards the plane for disk stars, even otherwise.
+ */
+double sin_galactic_latitude(
+        SplitMix64& rng,
+        const SyntheticCatalogOptions& options
+) {
+    if (rng.uniform() >= options.disk_fraction)
+        return rng.uniform(-1, 1);
+
+    // Laplace distribution around the plane, redrawn outside the sphere
+    for (;;) {
+        const double height = -options.disk_scale * std::log(1 - rng.uniform());
+        if (height <= 1)
+            return rng.uniform() < 0.5 ? -height : height;
+    }
+}
+
+
+/**
+ * \brief   Draws a position on the sky; returns RA and Dec in degrees.
+ */
+void sky_position(
+        SplitMix64& rng,
+        const SyntheticCatalogOptions& options,
+        double& ra,
+        double& dec
+) {
+    const double sin_b = sin_galactic_latitude(rng, options);
+    const double cos_b = std::sqrt(1 - sin_b * sin_b);
+    const double l = rng.uniform(0, 2 * M_PI);
+    const double galactic[3] = {cos_b * std::cos(l), cos_b * std::sin(l), sin_b};
+
+    double icrs[3];
+    for (int i = 0; i < 3; i++)
+        icrs[i] = GALACTIC_TO_ICRS[i][0] * galactic[0] + GALACTIC_TO_ICRS[i][1] * galactic[1] + GALACTIC_TO_ICRS[i][2] * galactic[2];
+
+    ra = std::atan2(icrs[1], icrs[0]) * 180 / M_PI;
+    if (ra < 0)
+        ra += 360;
+    dec = std::asin(std::clamp(icrs[2], -1.0, 1.0)) * 180 / M_PI;
+}
+
+
+/**
+ * \brief   V magnitude with counts growing by 10^COUNT_SLOPE per magnitude.
+ */
+double v_magnitude(
+        SplitMix64& rng,
+        const SyntheticCatalogOptions& options
+) {
+    const double low = std::pow(10, COUNT_SLOPE * MIN_MAGNITUDE);
+    const double high = std::pow(10, COUNT_SLOPE * options.max_magnitude);
+    return std::log10(low + rng.uniform() * (high - low)) / COUNT_SLOPE;
+}
+
+
+/**
+ * \brief   Photometric error, growing towards the faint end like Tycho's.
+ */
+double magnitude_error(const double mag) {
+    return std::min(0.999, 0.005 * std::pow(10, 0.2 * (mag - 8)));
+}
+
+
+enum class Malformation {
+    none,
+    no_magnitude,
+    bad_ra,
+    truncated,
+};
+
+
+void append_row(
+        const SyntheticCatalogOptions& options,
+        const std::size_t row,
+        std::string& text
+) {
+    SplitMix64 rng(options.seed * 0x2545F4914F6CDD1Dull ^ (row * 0x9E3779B97F4A7C15ull));
+
+    double ra, dec;
+    sky_position(rng, options, ra, dec);
+    const double v = v_magnitude(rng, options);
+    const double colour = std::clamp(0.7 + 0.45 * rng.normal(), -0.4, 3.0);
+    const double vt = v + 0.090 * colour;
+    const double bt = vt + colour;
+    const double pm_ra = 20 * rng.normal();
+    const double pm_de = 20 * rng.normal();
+    const double epoch_ra = rng.uniform(1.0, 2.5);
+    const double epoch_de = rng.uniform(1.0, 2.5);
+
+    auto malformation = Malformation::none;
+    if (rng.uniform() < options.malformed_fraction)
+        malformation = static_cast<Malformation>(1 + static_cast<int>(rng.uniform() * 3));
+    bool blank_bt = rng.uniform() < options.blank_bt_fraction;
+    const bool blank_vt = rng.uniform() < options.blank_vt_fraction;
+    // A row without any magnitude is one of the malformed ones
+    if (blank_bt && blank_vt)
+        blank_bt = false;
+    if (malformation == Malformation::no_magnitude)
+        blank_bt = true;
+    const bool no_vt = blank_vt || malformation == Malformation::no_magnitude;
+
+    // Observed position at the epoch of observation, moved back from the mean position at J2000
+    const double cos_dec = std::max(1e-6, std::cos(dec * M_PI / 180));
+    const double mean_ra = std::fmod(ra + pm_ra * (2000 - 1990 - epoch_ra) / 3.6e6 / cos_dec + 360, 360);
+    const double mean_dec = std::clamp(dec + pm_de * (2000 - 1990 - epoch_de) / 3.6e6, -90.0, 90.0);
+
+    char bt_text[16] = "      |     ";
+    if (!blank_bt)
+        std::snprintf(bt_text, sizeof(bt_text), "%6.3f|%5.3f", bt, magnitude_error(bt));
+    char vt_text[16] = "      |     ";
+    if (!no_vt)
+        std::snprintf(vt_text, sizeof(vt_text), "%6.3f|%5.3f", vt, magnitude_error(vt));
+    char hip_text[16] = "         ";
+    if (v < 9 && rng.uniform() < 0.7)
+        std::snprintf(hip_text, sizeof(hip_text), "%6u   ", static_cast<unsigned>(1 + row % 120000));
+
+    char line[320];
+    int length = std::snprintf(
+        line,
+        sizeof(line),
+        "%04u %05u %1u| |%12.8f|%12.8f|%7.1f|%7.1f|%3d|%3d|%4.1f|%4.1f|%7.2f|%7.2f|%2d|%3.1f|%3.1f|%3.1f|%3.1f|%s|%s",
+        static_cast<unsigned>(1 + row % GSC_REGIONS),
+        static_cast<unsigned>(1 + (row / GSC_REGIONS) % 99999),
+        static_cast<unsigned>(1 + row / (GSC_REGIONS * 99999)),
+        mean_ra,
+        mean_dec,
+        pm_ra,
+        pm_de,
+        10 + static_cast<int>(rng.uniform() * 90),
+        10 + static_cast<int>(rng.uniform() * 90),
+        rng.uniform(0.5, 3.0),
+        rng.uniform(0.5, 3.0),
+        1990 + epoch_ra - rng.uniform(10, 30),
+        1990 + epoch_de - rng.uniform(10, 30),
+        2 + static_cast<int>(rng.uniform() * 20),
+        rng.uniform(0.5, 2.0),
+        rng.uniform(0.5, 2.0),
+        rng.uniform(0.5, 2.0),
+        rng.uniform(0.5, 2.0),
+        bt_text,
+        vt_text
+    );
+    if (malformation != Malformation::truncated) {
+        char ra_text[16];
+        if (malformation == Malformation::bad_ra)
+            std::snprintf(ra_text, sizeof(ra_text), "  ----------");
+        else
+            std::snprintf(ra_text, sizeof(ra_text), "%12.8f", ra);
+        length += std::snprintf(
+            line + length,
+            sizeof(line) - length,
+            "|999| |%s|%s|%12.8f|%4.2f|%4.2f|%5.1f|%5.1f| |%4.1f",
+            hip_text,
+            ra_text,
+            dec,
+            epoch_ra,
+            epoch_de,
+            rng.uniform(5, 150),
+            rng.uniform(5, 150),
+            rng.uniform(-0.9, 0.9)
+        );
+    }
+    text.append(line, length);
+    text += '\n';
+}
+
+}
+
+
+std::string synthetic_catalog_rows(
+        const SyntheticCatalogOptions& options,
+        const std::size_t first_row,
+        const std::size_t count
+) {
+    std::string text;
+    // Full rows are 207 bytes
+    text.reserve(count * 208);
+    for (std::size_t row = first_row; row < first_row + count; row++)
+        append_row(options, row, text);
+    return text;
+}
+
+
+void write_synthetic_catalog(
+        const std::string& path,
+        const SyntheticCatalogOptions& options
+) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error(
+            (
+                boost::format("Failed to create %1%") % path
+            ).str()
+        );
+
+    const std::size_t threads = options.threads != 0
+        ? options.threads
+        : std::max(1u, std::thread::hardware_concurrency());
+
+    // Format a round of chunks in parallel, then write them in order
+    for (std::size_t first_row = 0; first_row < options.rows; ) {
+        std::vector<std::future<std::string>> chunks;
+        for (std::size_t i = 0; i < threads && first_row < options.rows; i++) {
+            const auto count = std::min(CHUNK_ROWS, options.rows - first_row);
+            chunks.push_back(std::async(std::launch::async, synthetic_catalog_rows, std::cref(options), first_row, count));
+            first_row += count;
+        }
+        for (auto& chunk : chunks) {
+            const auto text = chunk.get();
+            file.write(text.data(), text.size());
+        }
+        if (!file)
+            throw std::runtime_error(
+                (
+                    boost::format("Failed to write %1%") % path
+                ).str()
+            );
+    }
+}
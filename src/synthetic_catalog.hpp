@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+/**
+ * \brief   Shape of a synthetic Tycho-2 catalog.
+ */
+struct SyntheticCatalogOptions {
+    std::size_t rows = 2539913;
+    uint64_t seed = 1;
+    /// Share of stars in the galactic disk; the others are spread evenly over the sky
+    double disk_fraction = 0.6;
+    /// Scale height of the disk, in sin(galactic latitude)
+    double disk_scale = 0.1;
+    /// Faintest V magnitude; counts grow by a factor of 10^0.45 per magnitude up to it
+    double max_magnitude = 12.5;
+    /// Shares of rows with a blank BT, a blank VT, and rows that fail to parse
+    double blank_bt_fraction = 0.08;
+    double blank_vt_fraction = 0.01;
+    double malformed_fraction = 0.0003;
+    /// Threads formatting rows; zero means one per hardware thread
+    std::size_t threads = 0;
+};
+
+
+/**
+ * \brief   Formats rows of a synthetic catalog in the layout of the Tycho-2 catalog.dat.
+ *
+ * Every row is derived from the seed and its row number alone, so any range
+ * of rows is the same whether it is generated on its own or as part of a
+ * larger file.
+ *
+ * Malformed rows lack both magnitudes, have a non-numeric RA or end after
+ * the VT column.
+ *
+ * \return  count rows from first_row on, each ended by "\n"
+ */
+std::string synthetic_catalog_rows(
+        const SyntheticCatalogOptions& options,
+        const std::size_t first_row,
+        const std::size_t count
+);
+
+
+/**
+ * \brief   Writes a synthetic catalog, formatting chunks of rows on several threads.
+ *
+ * \throw   std::runtime_error if the file can not be written
+ */
+void write_synthetic_catalog(
+        const std::string& path,
+        const SyntheticCatalogOptions& options
+);
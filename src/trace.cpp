@@ -0,0 +1,106 @@
+#include "trace.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <boost/format.hpp>
+
+#include "json.hpp"
+
+
+namespace {
+
+#ifdef STARFINDER_TRACING
+std::atomic<TraceRecorder*> active_recorder{nullptr};
+#endif
+
+
+/**
+ * \brief   Small, stable identifier of the calling thread, in the order threads first record.
+ */
+uint32_t trace_thread_id() {
+    static std::atomic<uint32_t> next_id{1};
+    thread_local const uint32_t id = next_id++;
+    return id;
+}
+
+
+/**
+ * \brief   Microseconds, the unit of Chrome trace timestamps.
+ */
+double microseconds(const TraceRecorder::Clock::duration duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+}
+
+
+TraceRecorder::TraceRecorder():
+        origin(Clock::now())
+{}
+
+
+void TraceRecorder::add(
+        const char* name,
+        const Clock::time_point start,
+        const Clock::time_point stop
+) {
+    const Event event{name, trace_thread_id(), start, stop - start};
+    std::lock_guard<std::mutex> lock(mutex);
+    events.push_back(event);
+}
+
+
+void TraceRecorder::name_thread(const std::string& name) {
+    const auto thread = trace_thread_id();
+    std::lock_guard<std::mutex> lock(mutex);
+    thread_names.emplace_back(thread, name);
+}
+
+
+void TraceRecorder::write_json(std::ostream& out) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n";
+    bool first = true;
+    for (const auto& [thread, name] : thread_names) {
+        out << (first ? "" : ",\n");
+        out << boost::format("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %1%, \"args\": {\"name\": ") % thread;
+        write_json_string(out, name);
+        out << "}}";
+        first = false;
+    }
+    for (const auto& event : events) {
+        out << (first ? "" : ",\n");
+        out << boost::format("{\"name\": \"%1%\", \"cat\": \"starfinder\", \"ph\": \"X\", \"pid\": 1, \"tid\": %2%, \"ts\": %3$.3f, \"dur\": %4$.3f}")
+            % event.name
+            % event.thread
+            % microseconds(event.start - origin)
+            % microseconds(event.duration);
+        first = false;
+    }
+    out << "\n]}\n";
+}
+
+
+#ifdef STARFINDER_TRACING
+
+TraceRecorder* active_trace() noexcept {
+    return active_recorder.load(std::memory_order_relaxed);
+}
+
+#endif
+
+
+void set_active_trace(TraceRecorder* recorder) {
+#ifdef STARFINDER_TRACING
+    active_recorder.store(recorder);
+#else
+    if (recorder)
+        throw std::runtime_error("Tracing is not compiled in; build with -DSTARFINDER_TRACING=ON");
+#endif
+}
+
+
+void name_trace_thread(const std::string& name) {
+    if (auto* const trace = active_trace())
+        trace->name_thread(name);
+}
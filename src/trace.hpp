@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+ * \brief   Scoped events of all threads, written in the Chrome trace event format.
+ *
+ * The file loads in chrome://tracing and ui.perfetto.dev. Events are kept in
+ * memory until the trace is written. Thread-safe.
+ */
+class TraceRecorder {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        TraceRecorder();
+
+        /**
+         * \param   name    a string literal; only the pointer is kept
+         */
+        void add(
+                const char* name,
+                const Clock::time_point start,
+                const Clock::time_point stop
+        );
+
+        /**
+         * \brief   Names the calling thread in the trace.
+         */
+        void name_thread(const std::string& name);
+
+        void write_json(std::ostream& out) const;
+
+    private:
+        struct Event {
+            const char* name;
+            uint32_t thread;
+            Clock::time_point start;
+            Clock::duration duration;
+        };
+
+        const Clock::time_point origin;
+        mutable std::mutex mutex;
+        std::vector<Event> events;
+        std::vector<std::pair<uint32_t, std::string>> thread_names;
+};
+
+
+#ifdef STARFINDER_TRACING
+
+/// Whether trace events are compiled in (-DSTARFINDER_TRACING=ON)
+constexpr bool TRACING_COMPILED = true;
+
+/**
+ * \brief   The recorder trace events go to, or nullptr while tracing is off.
+ */
+TraceRecorder* active_trace() noexcept;
+
+#else
+
+constexpr bool TRACING_COMPILED = false;
+
+/// Without STARFINDER_TRACING, trace scopes compile to nothing
+inline TraceRecorder* active_trace() noexcept {
+    return nullptr;
+}
+
+#endif
+
+
+/**
+ * \brief   Starts sending trace events to the recorder, or stops with nullptr.
+ *
+ * \throw   std::runtime_error if tracing is not compiled in
+ */
+void set_active_trace(TraceRecorder* recorder);
+
+
+/**
+ * \brief   Names the calling thread in the active trace, if any.
+ */
+void name_trace_thread(const std::string& name);
+
+
+/**
+ * \brief   Records an event from construction to stop() or destruction while tracing is on.
+ *
+ * Costs one atomic load when tracing is off, and nothing when it is not
+ * compiled in.
+ */
+class TraceScope {
+    public:
+        /**
+         * \param   name    a string literal
+         */
+        explicit TraceScope(const char* name) noexcept:
+                trace(active_trace()),
+                name(name),
+                start(trace ? TraceRecorder::Clock::now() : TraceRecorder::Clock::time_point())
+        {}
+
+        ~TraceScope() {
+            stop();
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+        void stop() noexcept {
+            if (!trace)
+                return;
+            try {
+                trace->add(name, start, TraceRecorder::Clock::now());
+            }
+            catch (...) {
+                // Out of memory for events; the trace misses this one
+            }
+            trace = nullptr;
+        }
+
+    private:
+        TraceRecorder* trace;
+        const char* const name;
+        const TraceRecorder::Clock::time_point start;
+};